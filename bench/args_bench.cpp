@@ -0,0 +1,133 @@
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "bench.h"
+
+std::atomic<std::size_t> bench::allocations(0);
+std::size_t bench::failures = 0;
+
+// Every allocation in the process goes through here so each case can report
+// how many it made
+void* operator new(std::size_t _size) {
+    bench::allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(_size == 0 ? 1 : _size);
+    if(p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *_p) noexcept {
+    std::free(_p);
+}
+
+void operator delete(void *_p, std::size_t) noexcept {
+    std::free(_p);
+}
+
+bench::Corpus::Corpus(const std::size_t _tokens) {
+    storage.reserve(_tokens);
+    storage.push_back("build");
+    while(storage.size() < _tokens) {
+        std::size_t i = storage.size();
+        switch(i%8) {
+            case 0:
+                storage.push_back("-abc");
+                break;
+            case 1:
+                storage.push_back("--opt"+std::to_string(i%16)+"=value"+std::to_string(i));
+                break;
+            case 2:
+                storage.push_back("-o");
+                storage.push_back("out/file"+std::to_string(i)+".o");
+                break;
+            case 3:
+                storage.push_back("--verbose");
+                break;
+            case 4:
+                storage.push_back("--mode=release");
+                break;
+            default:
+                storage.push_back("src/module"+std::to_string(i%97)+"/file"+std::to_string(i)+".cpp");
+                break;
+        }
+    }
+    storage.resize(_tokens);
+    if(!storage.empty() && storage.back() == "-o") {
+        storage.back() = "positional";
+    }
+    for(const auto &s : storage) {
+        argv.push_back(s.c_str());
+    }
+}
+
+void bench::Corpus::write(const char *_path) const {
+    std::FILE *f = std::fopen(_path, "w");
+    if(f == nullptr) {
+        std::perror(_path);
+        std::exit(1);
+    }
+    for(std::size_t i = 0; i < storage.size(); ++i) {
+        if(i%16 == 15) {
+            std::fprintf(f, "\"%s\"\n", storage[i].c_str());
+        }else {
+            std::fprintf(f, "%s\n", storage[i].c_str());
+        }
+    }
+    std::fclose(f);
+}
+
+bench::Names::Names(const std::size_t _count) {
+    for(std::size_t i = 0; i < _count; ++i) {
+        switch(i%3) {
+            case 0:
+                flags.push_back("flag-"+std::to_string(i));
+                break;
+            case 1:
+                options.push_back("option-"+std::to_string(i));
+                break;
+            default:
+                commands.push_back("command-"+std::to_string(i));
+                break;
+        }
+    }
+    help = "Some description that is long enough to be wrapped over more than one line when the usage text is rendered";
+}
+
+void bench::report(const char *_suite, const char *_impl, const std::size_t _size, const double _ns, const std::size_t _units, const char *_unit, const double _allocs) {
+    std::printf("%-10s %-9s %10zu %14.0f ns/op %10.1f ns/%-5s %12.1f allocs/op\n", _suite, _impl, _size, _ns, _ns/_units, _unit, _allocs);
+}
+
+void bench::reportBytes(const char *_suite, const char *_impl, const std::size_t _size, const std::size_t _bytes, const std::size_t _units, const char *_unit) {
+    std::printf("%-10s %-9s %10zu %14zu bytes %10.1f bytes/%s\n", _suite, _impl, _size, _bytes, double(_bytes)/_units, _unit);
+}
+
+void bench::setVariable(const std::string &_name, const std::string &_value) {
+#ifdef _WIN32
+    _putenv_s(_name.c_str(), _value.c_str());
+#else
+    setenv(_name.c_str(), _value.c_str(), 1);
+#endif
+}
+
+int main(int argc, char **argv) {
+    bool compiled = true;
+    bool header = true;
+    if(argc > 1) {
+        compiled = std::strcmp(argv[1], "compiled") == 0;
+        header = std::strcmp(argv[1], "header") == 0;
+    }
+
+    if(compiled) {
+        bench::runCompiled();
+    }
+    if(header) {
+        bench::runHeader();
+    }
+
+    if(bench::failures != 0) {
+        std::printf("%zu checks failed\n", bench::failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,1665 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <memory_resource>
+#include <ostream>
+#include <streambuf>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Shared between the two benchmark translation units, one built against the
+// compiled library (args.h) and one against the header-only version (Hargs.h)
+namespace bench {
+    extern std::atomic<std::size_t> allocations;
+    extern std::size_t failures;
+
+    class Corpus {
+        public:
+            std::vector<std::string> storage;
+            std::vector<const char*> argv;
+
+            Corpus(const std::size_t _tokens);
+            // Writes the tokens one per line, quoting some of them
+            void write(const char *_path) const;
+    };
+
+    class Names {
+        public:
+            std::vector<std::string> flags;
+            std::vector<std::string> options;
+            std::vector<std::string> commands;
+            std::string help;
+
+            Names(const std::size_t _count);
+    };
+
+    void report(const char *_suite, const char *_impl, const std::size_t _size, const double _ns, const std::size_t _units, const char *_unit, const double _allocs);
+    void reportBytes(const char *_suite, const char *_impl, const std::size_t _size, const std::size_t _bytes, const std::size_t _units, const char *_unit);
+    void setVariable(const std::string &_name, const std::string &_value);
+
+    inline double now() {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Enough repetitions to run each case for a meaningful amount of time
+    inline std::size_t reps(const std::size_t _units) {
+        std::size_t r = 2000000/(_units+1);
+        return r < 1 ? 1 : (r > 10000 ? 10000 : r);
+    }
+
+    template<class P>
+    void schema(P &_p) {
+        _p.addFlag("alpha", "First flag", 'a');
+        _p.addFlag("beta", "Second flag", 'b');
+        _p.addFlag("gamma", "Third flag", 'c');
+        _p.addFlag("verbose", "Print more", 'v');
+        _p.addOption("output", "Output file", 'o');
+        _p.addOption("mode", "Build mode", 'm', "debug", {"debug", "release", "profile"});
+        for(int i = 0; i < 16; ++i) {
+            _p.addOption("opt"+std::to_string(i), "Generic option");
+        }
+        _p.addCommand("build", "Build things");
+        _p.addCommand("clean", "Remove things");
+    }
+
+    // The same arguments as schema() in an args::schema, built by the compiler.
+    // S is the schema template of an implementation and T its spec type, whose
+    // kind member gives the spec kinds.
+    template<template<std::size_t> class S, class T>
+    class StaticSchema {
+        private:
+            using K = decltype(T::kind);
+
+        public:
+            static constexpr T specs[] = {
+                {K::flag, "alpha", 'a', {}},
+                {K::flag, "beta", 'b', {}},
+                {K::flag, "gamma", 'c', {}},
+                {K::flag, "verbose", 'v', {}},
+                {K::option, "output", 'o', {}},
+                {K::option, "mode", 'm', "debug"},
+                {K::option, "opt0", '\0', {}},
+                {K::option, "opt1", '\0', {}},
+                {K::option, "opt2", '\0', {}},
+                {K::option, "opt3", '\0', {}},
+                {K::option, "opt4", '\0', {}},
+                {K::option, "opt5", '\0', {}},
+                {K::option, "opt6", '\0', {}},
+                {K::option, "opt7", '\0', {}},
+                {K::option, "opt8", '\0', {}},
+                {K::option, "opt9", '\0', {}},
+                {K::option, "opt10", '\0', {}},
+                {K::option, "opt11", '\0', {}},
+                {K::option, "opt12", '\0', {}},
+                {K::option, "opt13", '\0', {}},
+                {K::option, "opt14", '\0', {}},
+                {K::option, "opt15", '\0', {}},
+                {K::command, "build", '\0', {}},
+                {K::command, "clean", '\0', {}}
+            };
+            static constexpr S<sizeof(specs)/sizeof(T)> parser = S<sizeof(specs)/sizeof(T)>(specs);
+    };
+
+    // A schema small enough to check by hand. The command verbose shares its
+    // name with a flag, which is allowed since commands have names of their own.
+    template<template<std::size_t> class S, class T>
+    class SmallSchema {
+        private:
+            using K = decltype(T::kind);
+
+        public:
+            static constexpr T specs[] = {
+                {K::flag, "verbose", 'v', {}},
+                {K::flag, "all", 'a', {}},
+                {K::option, "output", 'o', "a.out"},
+                {K::option, "level", 'l', "1"},
+                {K::command, "build", '\0', {}},
+                {K::command, "verbose", '\0', {}}
+            };
+            static constexpr S<6> parser = S<6>(specs);
+            // a flag and an option may not share a name, a flag and a command may
+            static constexpr T duplicate[] = {{K::flag, "name", '\0', {}}, {K::option, "name", '\0', {}}};
+            static constexpr T shared[] = {{K::flag, "name", '\0', {}}, {K::command, "name", '\0', {}}};
+
+            static constexpr bool findsEveryName() {
+                for(std::size_t i = 0; i < parser.size(); ++i) {
+                    if(parser.find(specs[i].name, specs[i].kind == K::command) != i) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+    };
+
+    // Whether S<N> can be built from Specs in a constant expression. The
+    // constructor throws on a duplicate name, which makes the schema fail to
+    // compile; here that failure only removes the specialization.
+    template<template<std::size_t> class S, std::size_t N, const auto &Specs, class = void>
+    struct Builds : std::false_type {};
+
+    template<template<std::size_t> class S, std::size_t N, const auto &Specs>
+    struct Builds<S, N, Specs, std::void_t<std::integral_constant<std::size_t, S<N>(Specs).size()>>> : std::true_type {};
+
+    // The compile-time lookups of args::schema, and that it parses like an
+    // ArgParser with the same arguments
+    template<class P, template<std::size_t> class S, class T>
+    void staticSchema(const char *_impl) {
+        using Small = SmallSchema<S, T>;
+        using K = decltype(T::kind);
+        constexpr std::size_t npos = S<6>::npos;
+        static_assert(Small::findsEveryName(), "every name is found under its own kind");
+        static_assert(Small::parser.find("verbose") == 0 && Small::parser.find("verbose", true) == 5, "a flag and a command share a name");
+        static_assert(Small::parser.find("build") == npos && Small::parser.find("output", true) == npos, "commands are apart from flags and options");
+        static_assert(Small::parser.find("missing") == npos && Small::parser.find("missing", true) == npos && Small::parser.find("") == npos, "unknown names are npos");
+        static_assert(Small::parser.find('v', K::flag) == 0 && Small::parser.find('o', K::option) == 2, "abbreviations are found");
+        static_assert(Small::parser.find('v', K::option) == npos && Small::parser.find('x', K::flag) == npos, "abbreviations are kept per kind");
+        static_assert(!Builds<S, 2, Small::duplicate>::value, "a duplicate name does not compile");
+        static_assert(Builds<S, 2, Small::shared>::value, "a flag and a command may share a name");
+
+        P p("bench");
+        for(const T &spec : Small::specs) {
+            if(spec.kind == K::flag) {
+                p.addFlag(std::string(spec.name), "", spec.abbr);
+            }else if(spec.kind == K::option) {
+                p.addOption(std::string(spec.name), "", spec.abbr, std::string(spec.defaults_to));
+            }else {
+                p.addCommand(std::string(spec.name));
+            }
+        }
+        std::vector<std::vector<const char*>> lines = {
+            {"-va", "--output=x", "build", "file"},
+            {"-v", "build", "clean"},
+            {"--level", "3", "-o", "y", "verbose"},
+            {"file", "build"},
+            {"--all", "-l", "2"},
+            {}
+        };
+        std::size_t mismatches = 0;
+        for(const auto &line : lines) {
+            auto expected = p.parseView(line.data(), line.size());
+            auto results = Small::parser.parse(line.data(), line.size());
+            for(const char *name : {"verbose", "all"}) {
+                mismatches += results.flag(name) != expected.flag[name] ? 1 : 0;
+            }
+            for(const char *name : {"output", "level"}) {
+                mismatches += results.option(name) != expected.option[name] ? 1 : 0;
+            }
+            if(results.command != expected.command || results.positional != expected.positional) {
+                ++mismatches;
+            }
+        }
+        if(mismatches != 0) {
+            std::printf("schema (%s): %zu mismatches\n", _impl, mismatches);
+            ++failures;
+        }
+    }
+
+    // How args::classify sorts the odd arguments, and what the parser makes of
+    // them. I names the types of one implementation, see compiled.cpp.
+    template<class I>
+    void tokens(const char *_impl) {
+        using K = typename I::token_kind;
+        enum outcome {positional, command, option, flag, invalid, missing, ignored};
+        struct row {
+            std::vector<std::string> argv;
+            K kind;
+            std::size_t equals;
+            outcome expected;
+        };
+        const std::size_t npos = std::string_view::npos;
+        const row table[] = {
+            {{"-"}, K::word, npos, positional},
+            {{"--"}, K::word, npos, positional},
+            {{"---x"}, K::word, npos, positional},
+            {{"-="}, K::short_cluster, 1, invalid},
+            {{"--="}, K::long_value, 2, invalid},
+            {{"--x="}, K::long_value, 3, missing},
+            {{"--x=1"}, K::long_value, 3, option},
+            {{"-\n"}, K::short_cluster, npos, invalid},
+            {{"--a\nb"}, K::word, npos, positional},
+            {{""}, K::empty, npos, ignored},
+            {{"build"}, K::word, npos, command},
+            {{"--x", "build"}, K::long_option, npos, option},
+            {{"-v", "build"}, K::short_cluster, npos, command}
+        };
+        typename I::parser p("bench");
+        p.addFlag("v", "Verbose", 'v');
+        p.addOption("x", "Value", 'o');
+        p.addCommand("build", "Build");
+        std::size_t mismatches = 0;
+        for(const row &r : table) {
+            const auto t = I::classify(r.argv[0]);
+            outcome got;
+            try {
+                const auto results = p.parse(r.argv);
+                if(!results.command.empty()) {
+                    got = command;
+                }else if(!results.positional.empty()) {
+                    got = positional;
+                }else if(!results.option["x"].empty()) {
+                    got = option;
+                }else if(results.flag["v"]) {
+                    got = flag;
+                }else {
+                    got = ignored;
+                }
+            }catch(const typename I::invalid_argument &) {
+                got = invalid;
+            }catch(const typename I::missing_value &) {
+                got = missing;
+            }
+            if(t.kind != r.kind || t.equals != r.equals || got != r.expected) {
+                std::printf("tokens (%s): \"%s\" is %d at %zu, parsed as %d\n", _impl, r.argv[0].c_str(), static_cast<int>(t.kind), t.equals, static_cast<int>(got));
+                ++mismatches;
+            }
+        }
+        if(mismatches != 0) {
+            ++failures;
+        }
+    }
+
+    template<class P, template<std::size_t> class S, class T>
+    void registration(const char *_impl) {
+        for(std::size_t n : {10, 100, 1000, 10000}) {
+            Names names(n);
+            std::size_t r = reps(n*20);
+            std::size_t before = allocations;
+            double start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                P p("bench", "registration benchmark");
+                for(std::size_t j = 0; j < names.flags.size(); ++j) {
+                    p.addFlag(names.flags[j], names.help);
+                }
+                for(std::size_t j = 0; j < names.options.size(); ++j) {
+                    p.addOption(names.options[j], names.help, '\0', "default");
+                }
+                for(std::size_t j = 0; j < names.commands.size(); ++j) {
+                    p.addCommand(names.commands[j], names.help);
+                }
+            }
+            double elapsed = now()-start;
+            report("register", _impl, n, elapsed/r, n, "def", double(allocations-before)/r);
+        }
+
+        // schema() registered at startup, against the same arguments in an
+        // args::schema, which the compiler has already built
+        const std::size_t defs = sizeof(StaticSchema<S, T>::specs)/sizeof(T);
+        std::size_t r = reps(defs*20);
+        std::size_t before = allocations;
+        double start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            P p("bench");
+            schema(p);
+        }
+        double elapsed = now()-start;
+        report("reg parser", _impl, defs, elapsed/r, defs, "def", double(allocations-before)/r);
+
+        volatile std::size_t found = 0;
+        before = allocations;
+        start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            found = found+StaticSchema<S, T>::parser.find("verbose");
+        }
+        elapsed = now()-start;
+        report("reg schema", _impl, defs, elapsed/r, defs, "def", double(allocations-before)/r);
+    }
+
+    // Memory held by a parser, its rendered help and the results of parsing
+    template<class P>
+    void footprint(const char *_impl) {
+        for(std::size_t n : {10, 100, 1000, 10000}) {
+            Names names(n);
+            P p("bench", "footprint benchmark");
+            for(std::size_t j = 0; j < names.flags.size(); ++j) {
+                p.addFlag(names.flags[j], names.help, j < 26 ? char('a'+j) : '\0');
+            }
+            for(std::size_t j = 0; j < names.options.size(); ++j) {
+                p.addOption(names.options[j], names.help, j < 26 ? char('A'+j) : '\0', "default");
+            }
+            for(std::size_t j = 0; j < names.commands.size(); ++j) {
+                p.addCommand(names.commands[j], names.help);
+            }
+            p.help();
+            auto f = p.footprint();
+            reportBytes("names", _impl, n, f.names, n, "def");
+            reportBytes("defs", _impl, n, f.definitions, n, "def");
+            reportBytes("indexes", _impl, n, f.indexes, n, "def");
+            reportBytes("help", _impl, n, f.help, n, "def");
+            reportBytes("parser", _impl, n, f.total(), n, "def");
+
+            Corpus c(1000);
+            std::vector<const char*> argv;
+            for(const char *a : c.argv) {
+                // only the positionals, the corpus options are not in this schema
+                if(a[0] != '-' && a != c.argv[0]) {
+                    argv.push_back(a);
+                }
+            }
+            auto results = p.parse(argv.data(), argv.size());
+            reportBytes("results", _impl, n, results.footprint(), n, "def");
+        }
+    }
+
+    template<class P, template<std::size_t> class S, class T>
+    void parsing(const char *_impl) {
+        P p("bench");
+        schema(p);
+        const auto &fixed = StaticSchema<S, T>::parser;
+        for(std::size_t n : {10, 1000, 100000, 1000000}) {
+            Corpus c(n);
+            std::size_t r = reps(n);
+            std::size_t before = allocations;
+            double start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                auto results = p.parse(c.argv.data(), c.argv.size());
+                if(results.positional.empty()) {
+                    std::puts("unexpected result");
+                    ++failures;
+                }
+            }
+            double elapsed = now()-start;
+            report("parse", _impl, n, elapsed/r, n, "token", double(allocations-before)/r);
+
+            before = allocations;
+            start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                auto results = p.parseView(c.argv.data(), c.argv.size());
+                if(results.positional.empty()) {
+                    std::puts("unexpected result");
+                    ++failures;
+                }
+            }
+            elapsed = now()-start;
+            report("parseView", _impl, n, elapsed/r, n, "token", double(allocations-before)/r);
+
+            const auto expected = p.parseView(c.argv.data(), c.argv.size());
+            std::size_t mismatches = 0;
+            before = allocations;
+            start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                auto results = fixed.parse(c.argv.data(), c.argv.size());
+                if(results.positional.size() != expected.positional.size() || results.command != expected.command) {
+                    ++mismatches;
+                }
+            }
+            elapsed = now()-start;
+            report("schema", _impl, n, elapsed/r, n, "token", double(allocations-before)/r);
+            if(mismatches != 0) {
+                std::printf("schema parse: %zu mismatches\n", mismatches);
+                ++failures;
+            }
+
+            // Reused results alternate between a short and the full command
+            // line. After the first round nothing may allocate any more.
+            Corpus half(n/2+6);
+            decltype(p.parse(c.argv.data(), c.argv.size())) results;
+            decltype(p.parseView(c.argv.data(), c.argv.size())) view;
+            for(std::size_t i = 0; i < 4; ++i) {
+                const Corpus &input = i%2 == 0 ? c : half;
+                p.parseInto(input.argv.data(), input.argv.size(), results);
+                p.parseInto(input.argv.data(), input.argv.size(), view);
+            }
+            before = allocations;
+            start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                const Corpus &input = i%2 == 0 ? c : half;
+                p.parseInto(input.argv.data(), input.argv.size(), results);
+                if(results.positional.empty()) {
+                    std::puts("unexpected result");
+                    ++failures;
+                }
+            }
+            elapsed = now()-start;
+            std::size_t steady = allocations-before;
+            report("parseInto", _impl, n, elapsed/r, n, "token", double(steady)/r);
+
+            before = allocations;
+            start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                const Corpus &input = i%2 == 0 ? c : half;
+                p.parseInto(input.argv.data(), input.argv.size(), view);
+                if(view.positional.empty()) {
+                    std::puts("unexpected result");
+                    ++failures;
+                }
+            }
+            elapsed = now()-start;
+            steady += allocations-before;
+            report("parseInto view", _impl, n, elapsed/r, n, "token", double(allocations-before)/r);
+
+            if(steady != 0) {
+                std::printf("parseInto allocated %zu times after warming up\n", steady);
+                ++failures;
+            }
+        }
+    }
+
+    // Counts what visit reports without keeping any of it
+    template<class V>
+    class Counter : public V {
+        public:
+            std::size_t flags = 0;
+            std::size_t options = 0;
+            std::size_t positionals = 0;
+
+            void flag(const std::size_t /*_handle*/) {
+                ++flags;
+            }
+
+            void option(const std::size_t /*_handle*/, std::string_view /*_value*/) {
+                ++options;
+            }
+
+            void positional(std::string_view /*_arg*/) {
+                ++positionals;
+            }
+    };
+
+    // visit has to see every positional parseView collects, without allocating
+    template<class P, class V>
+    void streaming(const char *_impl) {
+        P p("bench");
+        schema(p);
+        for(std::size_t n : {10, 1000, 100000, 1000000}) {
+            Corpus c(n);
+            const auto expected = p.parseView(c.argv.data(), c.argv.size());
+            std::size_t r = reps(n);
+            std::size_t mismatches = 0;
+            std::size_t before = allocations;
+            double start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                Counter<V> counter;
+                p.visit(c.argv.data(), c.argv.size(), counter);
+                if(counter.positionals != expected.positional.size() || counter.flags == 0 || counter.options == 0) {
+                    ++mismatches;
+                }
+            }
+            double elapsed = now()-start;
+            std::size_t allocated = allocations-before;
+            report("visit", _impl, n, elapsed/r, n, "token", double(allocated)/r);
+
+            if(mismatches != 0 || allocated != 0) {
+                std::printf("visit: %zu mismatches, %zu allocations\n", mismatches, allocated);
+                ++failures;
+            }
+        }
+    }
+
+    // Parsing into a monotonic arena that is released after every parse must
+    // not touch the global heap once the arena is big enough
+    template<class P>
+    void arena(const char *_impl) {
+        P p("bench");
+        schema(p);
+        for(std::size_t n : {10, 1000, 100000, 1000000}) {
+            Corpus c(n);
+            const auto expected = p.parseView(c.argv.data(), c.argv.size());
+            std::vector<char> buffer(128*n+4096);
+            std::pmr::monotonic_buffer_resource resource(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+            std::size_t r = reps(n);
+            std::size_t mismatches = 0;
+            std::size_t before = allocations;
+            double start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                {
+                    auto results = p.parse(c.argv.data(), c.argv.size(), &resource);
+                    if(results.positional.size() != expected.positional.size() || results.command != expected.command) {
+                        ++mismatches;
+                    }
+                }
+                resource.release();
+            }
+            double elapsed = now()-start;
+            std::size_t allocated = allocations-before;
+            report("arena parse", _impl, n, elapsed/r, n, "token", double(allocated)/r);
+
+            if(mismatches != 0 || allocated != 0) {
+                std::printf("arena: %zu mismatches, %zu allocations\n", mismatches, allocated);
+                ++failures;
+            }
+        }
+    }
+
+    // Reading converted values has to give the same numbers as converting the
+    // strings again on every read, which is what callers did before. Half of
+    // them are negative, given after = or as the next argument.
+    template<class P, class K>
+    void typedValues(const char *_impl) {
+        P p("bench");
+        schema(p);
+        std::vector<std::string> args;
+        std::vector<std::size_t> handles;
+        for(int i = 0; i < 8; ++i) {
+            handles.push_back(p.addTypedOption("n"+std::to_string(i), K::integer, "Number", '\0', "0"));
+            std::string value = std::to_string((i%2 == 0 ? 1 : -1)*1000003*(i+1));
+            if(i%4 == 3) {
+                args.push_back("--n"+std::to_string(i));
+                args.push_back(value);
+            }else {
+                args.push_back("--n"+std::to_string(i)+"="+value);
+            }
+        }
+        const auto results = p.parse(args);
+        std::size_t r = 200000;
+        double start = now();
+        std::int64_t typed = 0;
+        for(std::size_t i = 0; i < r; ++i) {
+            for(std::size_t h : handles) {
+                typed += results.typed.integer(h)^i;
+            }
+        }
+        double elapsed = now()-start;
+        report("typed read", _impl, handles.size(), elapsed/r, handles.size(), "value", 0);
+
+        start = now();
+        std::int64_t converted = 0;
+        for(std::size_t i = 0; i < r; ++i) {
+            for(std::size_t h : handles) {
+                converted += std::stoll(results.option[h])^i;
+            }
+        }
+        elapsed = now()-start;
+        report("stoll read", _impl, handles.size(), elapsed/r, handles.size(), "value", 0);
+
+        if(typed != converted) {
+            std::printf("typed: %lld != %lld\n", static_cast<long long>(typed), static_cast<long long>(converted));
+            ++failures;
+        }
+    }
+
+    // Every kind has to take the values its rules allow and reject the rest
+    // with invalid_value, whether the value is attached with = or follows.
+    // Only integer and real values may start with '-', for the others the
+    // value is missing
+    template<class P, class K, class X, class M>
+    void conversions(const char *_impl) {
+        enum outcome {accepted, invalid, missing};
+        struct row {
+            K kind;
+            const char *value;
+            outcome expected;
+            std::int64_t integer;
+        };
+        const std::int64_t second = 1000000000;
+        const row table[] = {
+            {K::integer, "42", accepted, 42},
+            {K::integer, "-7", accepted, -7},
+            {K::integer, "0x10", invalid, 0},
+            {K::integer, "12abc", invalid, 0},
+            {K::integer, "99999999999999999999", invalid, 0},
+            {K::real, "1.5", accepted, 1},
+            {K::real, "-2.5", accepted, -2},
+            {K::real, "1e300", accepted, std::numeric_limits<std::int64_t>::max()},
+            {K::real, "inf", invalid, 0},
+            {K::real, "nan", invalid, 0},
+            {K::real, "1e400", invalid, 0},
+            {K::boolean, "yes", accepted, 1},
+            {K::boolean, "off", accepted, 0},
+            {K::boolean, "TRUE", invalid, 0},
+            {K::boolean, "-1", missing, 0},
+            {K::duration, "1h30m", accepted, 5400*second},
+            {K::duration, "5", accepted, 5*second},
+            {K::duration, "250ms", accepted, second/4},
+            {K::duration, "1.5s", invalid, 0},
+            {K::duration, "5x", invalid, 0},
+            {K::duration, "1h30", invalid, 0},
+            {K::duration, "-5s", missing, 0},
+            {K::size, "1KiB", accepted, 1024},
+            {K::size, "2M", accepted, 2097152},
+            {K::size, "1Ki", invalid, 0},
+            {K::size, "99999999999T", invalid, 0},
+            {K::size, "-5", missing, 0},
+            {K::choice, "green", accepted, 1},
+            {K::choice, "blue", invalid, 0},
+            {K::integer, "", missing, 0},
+            {K::choice, "", missing, 0}
+        };
+        std::size_t mismatches = 0;
+        double start = now();
+        for(const row &r : table) {
+            for(bool attached : {true, false}) {
+                P p("bench");
+                std::size_t h = p.addTypedOption("x", r.kind, "Value", 'x', "", r.kind == K::choice ? std::vector<std::string>{"red", "green"} : std::vector<std::string>{});
+                std::vector<std::string> argv;
+                if(attached) {
+                    argv = {std::string("--x=")+r.value};
+                }else {
+                    argv = {"--x", r.value};
+                }
+                outcome got = accepted;
+                std::int64_t integer = 0;
+                try {
+                    integer = p.parse(argv).typed.integer(h);
+                }catch(const X &) {
+                    got = invalid;
+                }catch(const M &) {
+                    got = missing;
+                }
+                if(got != r.expected || (got == accepted && integer != r.integer)) {
+                    std::printf("conversion %s %s: got %d %lld\n", argv[0].c_str(), attached ? "" : r.value, static_cast<int>(got), static_cast<long long>(integer));
+                    ++mismatches;
+                }
+            }
+        }
+        double elapsed = now()-start;
+        report("conversions", _impl, sizeof(table)/sizeof(row), elapsed/(2*sizeof(table)/sizeof(row)), 1, "parse", 0);
+        if(mismatches != 0) {
+            ++failures;
+        }
+    }
+
+    // Checking a value against a large allowed set has to stay a hash lookup,
+    // and the index of the value has to be the one it was added with
+    template<class P>
+    void allowedValues(const char *_impl) {
+        for(std::size_t n : {10, 1000, 100000}) {
+            std::vector<std::string> allowed;
+            for(std::size_t i = 0; i < n; ++i) {
+                allowed.push_back("sku-"+std::to_string(i*7919));
+            }
+            P p("bench");
+            std::size_t sku = p.addOption("sku", "Product code", 's', "", allowed);
+            std::vector<std::string> argv = {"--sku", ""};
+            decltype(p.parse(argv)) results;
+            std::size_t r = 100000;
+            std::size_t mismatches = 0;
+            std::size_t before = allocations;
+            double start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                std::size_t expected = (i*31)%n;
+                argv[1] = allowed[expected];
+                p.parseInto(argv, results);
+                if(results.typed.choice(sku) != expected) {
+                    ++mismatches;
+                }
+            }
+            double elapsed = now()-start;
+            report("allowed", _impl, n, elapsed/r, 1, "check", double(allocations-before)/r);
+
+            if(mismatches != 0) {
+                std::printf("allowed: %zu mismatches\n", mismatches);
+                ++failures;
+            }
+        }
+    }
+
+    // A compiler driver command line: hundreds of -I and -D and a -vvv. Every
+    // value has to be kept in order, and reused results must stop allocating.
+    template<class P>
+    void repeated(const char *_impl) {
+        P p("bench");
+        std::size_t verbose = p.addCounter("verbose", "More output", 'v');
+        std::size_t include = p.addRepeatedOption("include", "Include directory", 'I');
+        std::size_t define = p.addRepeatedOption("define", "Preprocessor definition", 'D');
+        for(std::size_t n : {4, 100, 1000}) {
+            std::vector<std::string> args = {"-vvv"};
+            for(std::size_t i = 0; i < n; ++i) {
+                args.push_back(i%2 == 0 ? "-I" : "-D");
+                args.push_back(i%2 == 0 ? "/usr/include/project/module"+std::to_string(i) : "FEATURE_"+std::to_string(i)+"=1");
+            }
+            std::vector<std::string> half(args.begin(), args.begin()+n+1);
+            decltype(p.parse(args)) results;
+            for(std::size_t i = 0; i < 4; ++i) {
+                p.parseInto(i%2 == 0 ? args : half, results);
+            }
+            std::size_t r = reps(2*n);
+            std::size_t mismatches = 0;
+            std::size_t before = allocations;
+            double start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                p.parseInto(i%2 == 0 ? args : half, results);
+                std::size_t expected = i%2 == 0 ? n : n/2;
+                if(results.repeated[include].size()+results.repeated[define].size() != expected || results.flag.count(verbose) != 3) {
+                    ++mismatches;
+                }
+            }
+            double elapsed = now()-start;
+            std::size_t allocated = allocations-before;
+            report("repeated", _impl, n, elapsed/r, n, "value", double(allocated)/r);
+
+            if(results.repeated[define].size() > 0 && results.repeated[define][0] != "FEATURE_1=1") {
+                ++mismatches;
+            }
+            if(mismatches != 0 || allocated != 0) {
+                std::printf("repeated: %zu mismatches, %zu allocations\n", mismatches, allocated);
+                ++failures;
+            }
+        }
+    }
+
+    // One option carrying tens of thousands of comma separated shard ids. The
+    // elements have to point into argv and parsing again must not allocate.
+    template<class P>
+    void lists(const char *_impl) {
+        P p("bench");
+        std::size_t shards = p.addListOption("shards", "Shards to query", 's');
+        for(std::size_t n : {10, 1000, 50000}) {
+            std::string value;
+            for(std::size_t i = 0; i < n; ++i) {
+                value.append(i == 0 ? "" : ",").append("shard-"+std::to_string(i*7919%100003));
+            }
+            const char *argv[] = {"--shards", value.c_str()};
+            decltype(p.parseView(argv, 2)) results;
+            p.parseInto(argv, 2, results);
+            std::size_t r = reps(n);
+            std::size_t mismatches = 0;
+            std::size_t before = allocations;
+            double start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                p.parseInto(argv, 2, results);
+                if(results.option.list(shards).size() != n) {
+                    ++mismatches;
+                }
+            }
+            double elapsed = now()-start;
+            std::size_t allocated = allocations-before;
+            report("lists", _impl, n, elapsed/r, n, "element", double(allocated)/r);
+
+            std::size_t length = n-1;
+            for(std::string_view shard : results.option.list(shards)) {
+                length += shard.size();
+            }
+            if(length != value.size() || results.option.list(shards)[0].data() != value.c_str()) {
+                ++mismatches;
+            }
+            if(mismatches != 0 || allocated != 0) {
+                std::printf("lists: %zu mismatches, %zu allocations\n", mismatches, allocated);
+                ++failures;
+            }
+        }
+    }
+
+    // Thousands of -DKEY=value definitions, a tenth of them given twice. Later
+    // values have to win, and reused results must stop allocating. A key has
+    // to be given in every form, and an empty one is an invalid value.
+    template<class P, class X>
+    void maps(const char *_impl) {
+        P p("bench");
+        std::size_t define = p.addMapOption("define", "Preprocessor definition", 'D');
+        const auto forms = p.parse(std::vector<std::string>{"-DA=1", "-D", "B=2", "--define", "C=3", "--define=D=4", "-DNDEBUG"});
+        const auto given = forms.map[define];
+        bool keyed = given.size() == 5 && given["A"] == "1" && given["B"] == "2" && given["C"] == "3" && given["D"] == "4" && given.contains("NDEBUG");
+        for(const auto &empty : std::vector<std::vector<std::string>>{{"-D=x"}, {"-D", "=x"}, {"--define", "=3"}, {"--define==3"}}) {
+            try {
+                p.parse(empty);
+                keyed = false;
+            }catch(const X &) {}
+        }
+        if(!keyed) {
+            std::puts("maps: keys differ or an empty key was accepted");
+            ++failures;
+        }
+        for(std::size_t n : {10, 1000, 10000}) {
+            std::vector<std::string> args;
+            for(std::size_t i = 0; i < n; ++i) {
+                args.push_back("-DCONFIG_OPTION_"+std::to_string(i)+"="+std::to_string(i));
+            }
+            for(std::size_t i = 0; i < n; i += 10) {
+                args.push_back("-DCONFIG_OPTION_"+std::to_string(i)+"=override");
+            }
+            decltype(p.parse(args)) results;
+            p.parseInto(args, results);
+            std::size_t r = reps(args.size());
+            std::size_t mismatches = 0;
+            std::size_t before = allocations;
+            double start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                p.parseInto(args, results);
+                if(results.map[define].size() != n) {
+                    ++mismatches;
+                }
+            }
+            double elapsed = now()-start;
+            std::size_t allocated = allocations-before;
+            report("maps", _impl, n, elapsed/r, args.size(), "entry", double(allocated)/r);
+
+            for(std::size_t i = 0; i < n; ++i) {
+                std::string_view value = results.map[define]["CONFIG_OPTION_"+std::to_string(i)];
+                if(value != (i%10 == 0 ? "override" : std::to_string(i))) {
+                    ++mismatches;
+                }
+            }
+            if(mismatches != 0 || allocated != 0) {
+                std::printf("maps: %zu mismatches, %zu allocations\n", mismatches, allocated);
+                ++failures;
+            }
+        }
+    }
+
+    // A 400 option tool in a container with a few hundred variables, a quarter
+    // of the options bound to one. Parsing reads the environment once; calling
+    // getenv for every bound option is the baseline. A repeated option, a map
+    // option and a counter given on the command line drop what their variables
+    // gave them instead of adding to it.
+    template<class P, class D>
+    void environment(const char *_impl) {
+        P p("bench");
+        std::vector<std::string> variables;
+        std::vector<std::string> expected;
+        std::vector<std::size_t> handles;
+        for(std::size_t i = 0; i < 400; ++i) {
+            std::size_t handle = p.addOption("setting-"+std::to_string(i), "Setting", '\0', "default");
+            if(i%4 == 0) {
+                variables.push_back("BENCH_SETTING_"+std::to_string(i));
+                expected.push_back("env-"+std::to_string(i));
+                handles.push_back(handle);
+                p.bindEnv("setting-"+std::to_string(i), variables.back());
+                setVariable(variables.back(), expected.back());
+            }
+        }
+        for(std::size_t i = 0; i < 300; ++i) {
+            setVariable("BENCH_UNRELATED_"+std::to_string(i), "/usr/local/share/value"+std::to_string(i));
+        }
+        std::vector<std::string> args = {"--setting-0=argv"};
+        expected[0] = "argv";
+        decltype(p.parse(args)) results;
+        p.parseInto(args, results);
+        std::size_t r = 20000;
+        std::size_t mismatches = 0;
+        std::size_t before = allocations;
+        double start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            p.parseInto(args, results);
+            std::size_t k = i%handles.size();
+            if(results.option[handles[k]] != expected[k]) {
+                ++mismatches;
+            }
+        }
+        double elapsed = now()-start;
+        std::size_t allocated = allocations-before;
+        report("env scan", _impl, variables.size(), elapsed/r, variables.size(), "var", double(allocated)/r);
+
+        start = now();
+        std::size_t found = 0;
+        for(std::size_t i = 0; i < r; ++i) {
+            for(const auto &v : variables) {
+                found += std::getenv(v.c_str()) != nullptr ? 1 : 0;
+            }
+        }
+        elapsed = now()-start;
+        report("getenv", _impl, variables.size(), elapsed/r, variables.size(), "var", 0);
+
+        P layered("bench");
+        std::size_t include = layered.addRepeatedOption("include", "Include directory", 'I');
+        std::size_t define = layered.addMapOption("define", "Preprocessor definition", 'D', D::error);
+        std::size_t verbose = layered.addCounter("verbose", "More output", 'v');
+        layered.bindEnv("include", "BENCH_INCLUDE");
+        layered.bindEnv("define", "BENCH_DEFINE");
+        layered.bindEnv("verbose", "BENCH_VERBOSE");
+        setVariable("BENCH_INCLUDE", "/env/include");
+        setVariable("BENCH_DEFINE", "A=1");
+        setVariable("BENCH_VERBOSE", "1");
+        std::vector<std::string> none;
+        std::vector<std::string> given = {"-I", "/argv/include", "-DA=2", "-vv"};
+        decltype(layered.parse(given)) layered_results;
+        layered.parseInto(given, layered_results);
+        before = allocations;
+        for(std::size_t i = 0; i < 1000; ++i) {
+            try {
+                layered.parseInto(i%2 == 0 ? given : none, layered_results);
+            }catch(...) {
+                ++mismatches;
+                continue;
+            }
+            auto includes = layered_results.repeated[include];
+            auto defines = layered_results.map[define];
+            if(includes.size() != 1 || includes[0] != (i%2 == 0 ? "/argv/include" : "/env/include")
+                || defines.size() != 1 || defines["A"] != (i%2 == 0 ? "2" : "1")
+                || layered_results.flag.count(verbose) != (i%2 == 0 ? 2 : 1)) {
+                ++mismatches;
+            }
+        }
+        allocated += allocations-before;
+
+        if(mismatches != 0 || allocated != 0 || found != r*variables.size()) {
+            std::printf("environment: %zu mismatches, %zu allocations\n", mismatches, allocated);
+            ++failures;
+        }
+    }
+
+    // A 400 option tool with every option set in its config file. Loading checks
+    // each value once; a reload of an unchanged file is one stat, and a parse
+    // replays the loaded values without touching the file. A repeated option, a
+    // map option and a counter given on the command line drop what the file
+    // gave them instead of adding to it.
+    template<class P, class D>
+    void config(const char *_impl) {
+        P p("bench");
+        const char *path = "args_bench.ini";
+        std::string text = "; bench\n";
+        for(std::size_t i = 0; i < 400; ++i) {
+            p.addOption("setting-"+std::to_string(i), "Setting", '\0', "default", {"low", "medium", "high"});
+            text += "setting-"+std::to_string(i)+" = "+(i%3 == 0 ? "low" : i%3 == 1 ? "medium" : "high")+"\n";
+        }
+        std::FILE *out = std::fopen(path, "wb");
+        std::fwrite(text.data(), 1, text.size(), out);
+        std::fclose(out);
+
+        std::size_t r = 200;
+        double start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            p.loadConfig(path);
+        }
+        double elapsed = now()-start;
+        report("config load", _impl, 400, elapsed/r, 400, "key", 0);
+
+        r = 20000;
+        std::size_t reloaded = 0;
+        start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            reloaded += p.reloadConfig() ? 1 : 0;
+        }
+        elapsed = now()-start;
+        report("config reload", _impl, 1, elapsed/r, 1, "file", 0);
+
+        std::vector<std::string> args = {"--setting-0=high"};
+        decltype(p.parse(args)) results;
+        p.parseInto(args, results);
+        std::size_t mismatches = 0;
+        std::size_t before = allocations;
+        start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            p.parseInto(args, results);
+            std::size_t k = 1+i%399;
+            if(results.option[k] != (k%3 == 0 ? "low" : k%3 == 1 ? "medium" : "high") || results.option[0] != "high") {
+                ++mismatches;
+            }
+        }
+        elapsed = now()-start;
+        std::size_t allocated = allocations-before;
+        report("config parse", _impl, 400, elapsed/r, 400, "key", double(allocated)/r);
+
+        P layered("bench");
+        std::size_t include = layered.addRepeatedOption("include", "Include directory", 'I');
+        std::size_t define = layered.addMapOption("define", "Preprocessor definition", 'D', D::error);
+        std::size_t verbose = layered.addCounter("verbose", "More output", 'v');
+        text = "include = /file/include\ndefine = A=1\nverbose\nverbose\n";
+        out = std::fopen(path, "wb");
+        std::fwrite(text.data(), 1, text.size(), out);
+        std::fclose(out);
+        layered.loadConfig(path);
+        std::vector<std::string> none;
+        std::vector<std::string> given = {"-I", "/argv/include", "-DA=2", "-v"};
+        decltype(layered.parse(given)) layered_results;
+        layered.parseInto(given, layered_results);
+        before = allocations;
+        for(std::size_t i = 0; i < 1000; ++i) {
+            try {
+                layered.parseInto(i%2 == 0 ? given : none, layered_results);
+            }catch(...) {
+                ++mismatches;
+                continue;
+            }
+            auto includes = layered_results.repeated[include];
+            auto defines = layered_results.map[define];
+            if(includes.size() != 1 || includes[0] != (i%2 == 0 ? "/argv/include" : "/file/include")
+                || defines.size() != 1 || defines["A"] != (i%2 == 0 ? "2" : "1")
+                || layered_results.flag.count(verbose) != (i%2 == 0 ? 1 : 2)) {
+                ++mismatches;
+            }
+        }
+        allocated += allocations-before;
+        std::remove(path);
+
+        if(mismatches != 0 || allocated != 0 || reloaded != 0) {
+            std::printf("config: %zu mismatches, %zu allocations, %zu reloads\n", mismatches, allocated, reloaded);
+            ++failures;
+        }
+    }
+
+    // A tool with 200 subcommands of 30 options each. Setting it up registers
+    // factories only; the eager baseline builds every subcommand's parser, which
+    // is what registering them all up front costs.
+    template<class P>
+    void subcommands(const char *_impl) {
+        auto factory = [](P &_sub) {
+            for(std::size_t j = 0; j < 30; ++j) {
+                _sub.addOption("option-"+std::to_string(j), "An option of the subcommand", '\0', "default");
+            }
+        };
+        std::size_t r = 50;
+        std::size_t mismatches = 0;
+        double start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            P p("bench");
+            for(std::size_t c = 0; c < 200; ++c) {
+                p.addCommand("command-"+std::to_string(c), "A subcommand", factory);
+            }
+            auto results = p.parse(std::vector<std::string>{"command-7", "--option-3=x"});
+            if(results.subcommand == nullptr || results.subcommand->option["option-3"] != "x") {
+                ++mismatches;
+            }
+        }
+        double elapsed = now()-start;
+        report("subcmd lazy", _impl, 200, elapsed/r, 200, "cmd", 0);
+
+        start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            P p("bench");
+            for(std::size_t c = 0; c < 200; ++c) {
+                p.addCommand("command-"+std::to_string(c), "A subcommand", factory);
+                p.subparser("command-"+std::to_string(c));
+            }
+        }
+        elapsed = now()-start;
+        report("subcmd eager", _impl, 200, elapsed/r, 200, "cmd", 0);
+
+        P p("bench");
+        for(std::size_t c = 0; c < 200; ++c) {
+            p.addCommand("command-"+std::to_string(c), "A subcommand", factory);
+        }
+        std::vector<std::string> args = {"command-7", "--option-3=x"};
+        decltype(p.parse(args)) results;
+        p.parseInto(args, results);
+        std::size_t before = allocations;
+        r = 20000;
+        start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            p.parseInto(args, results);
+            if(results.subcommand->option["option-3"] != "x") {
+                ++mismatches;
+            }
+        }
+        elapsed = now()-start;
+        std::size_t allocated = allocations-before;
+        report("subcmd parse", _impl, 2, elapsed/r, 2, "token", double(allocated)/r);
+
+        if(mismatches != 0 || allocated != 0) {
+            std::printf("subcommands: %zu mismatches, %zu allocations\n", mismatches, allocated);
+            ++failures;
+        }
+    }
+
+    // A prefix of two names has to name both, and a flag given by a prefix
+    // still takes no value
+    template<class P, class A, class E>
+    void ambiguousPrefixes() {
+        P p("bench");
+        p.prefix_matching = true;
+        p.addFlag("version", "Print the version");
+        p.addFlag("verbose", "Print more");
+        p.addFlag("quiet", "Print less");
+        bool ok = p.parse(std::vector<std::string>{"--verb", "--qui"}).flag["verbose"];
+        try {
+            p.parse(std::vector<std::string>{"--ver"});
+            ok = false;
+        }catch(A &e) {
+            ok = ok && std::string(e.which()) == "ver" && e.candidates() == std::vector<std::string>{"verbose", "version"};
+        }
+        try {
+            p.parse(std::vector<std::string>{"--qui=x"});
+            ok = false;
+        }catch(const E &) {}
+        if(!ok) {
+            std::puts("prefixes: ambiguous or flag prefix with a value accepted");
+            ++failures;
+        }
+    }
+
+    // 1000 long options given by a unique prefix, e.g. --setting-7-v for
+    // --setting-7-value, against the same options given by their whole name
+    template<class P>
+    void prefixes(const char *_impl) {
+        P p("bench");
+        p.prefix_matching = true;
+        for(std::size_t i = 0; i < 1000; ++i) {
+            p.addOption("setting-"+std::to_string(i)+"-value", "A setting");
+        }
+        std::vector<std::string> whole;
+        std::vector<std::string> prefixed;
+        for(std::size_t i = 0; i < 100; ++i) {
+            std::string number = std::to_string(i*7%1000);
+            whole.push_back("--setting-"+number+"-value");
+            prefixed.push_back("--setting-"+number+"-v");
+            whole.push_back(number);
+            prefixed.push_back(number);
+        }
+        decltype(p.parse(whole)) results;
+        p.parseInto(whole, results);
+        std::size_t mismatches = 0;
+        std::size_t r = 2000;
+        std::size_t before = allocations;
+        double start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            p.parseInto(whole, results);
+        }
+        double elapsed = now()-start;
+        report("exact", _impl, 100, elapsed/r, 100, "opt", double(allocations-before)/r);
+
+        before = allocations;
+        start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            p.parseInto(prefixed, results);
+            if(results.option["setting-693-value"] != "693") {
+                ++mismatches;
+            }
+        }
+        elapsed = now()-start;
+        std::size_t allocated = allocations-before;
+        report("prefix", _impl, 100, elapsed/r, 100, "opt", double(allocated)/r);
+
+        if(mismatches != 0 || allocated != 0) {
+            std::printf("prefixes: %zu mismatches, %zu allocations\n", mismatches, allocated);
+            ++failures;
+        }
+    }
+
+    // Unknown names in a schema of 5000 options. The first one builds the
+    // index of names; parses without errors never do.
+    template<class P, class E>
+    void suggestions(const char *_impl) {
+        std::size_t mismatches = 0;
+        std::size_t r = 20;
+        double built = 0;
+        for(std::size_t i = 0; i < r; ++i) {
+            P p("bench");
+            for(std::size_t j = 0; j < 5000; ++j) {
+                p.addOption("option-"+std::to_string(j), "An option");
+            }
+            p.parse(std::vector<std::string>{"--option-12", "x"});
+            double start = now();
+            try {
+                p.parse(std::vector<std::string>{"--optoin-1234", "x"});
+                ++mismatches;
+            }catch(E &e) {
+                if(e.suggestions().empty() || e.suggestions()[0] != "--option-1234") {
+                    ++mismatches;
+                }
+            }
+            built += now()-start;
+        }
+        report("first typo", _impl, 5000, built/r, 1, "error", 0);
+
+        P p("bench");
+        for(std::size_t j = 0; j < 5000; ++j) {
+            p.addOption("option-"+std::to_string(j), "An option");
+        }
+        std::vector<std::vector<std::string>> typos;
+        for(std::size_t j = 0; j < 100; ++j) {
+            typos.push_back({"--optoin-"+std::to_string(j*37), "x"});
+        }
+        r = 20;
+        double start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            for(const auto &typo : typos) {
+                try {
+                    p.parse(typo);
+                    ++mismatches;
+                }catch(E &e) {
+                    if(e.suggestions().empty() || e.suggestions()[0] != "--option"+typo[0].substr(8)) {
+                        ++mismatches;
+                    }
+                }
+            }
+        }
+        double elapsed = now()-start;
+        report("typo", _impl, 5000, elapsed/(r*typos.size()), 1, "error", 0);
+
+        if(mismatches != 0) {
+            std::printf("suggestions: %zu mismatches\n", mismatches);
+            ++failures;
+        }
+    }
+
+    // Counts what is written to it, so writing the candidates costs no memory
+    class LineCounter : public std::streambuf {
+        public:
+            std::size_t lines = 0;
+
+        protected:
+            int_type overflow(int_type _c) override {
+                lines += _c == '\n';
+                return _c;
+            }
+
+            std::streamsize xsputn(const char *_s, std::streamsize _n) override {
+                lines += std::count(_s, _s+_n, '\n');
+                return _n;
+            }
+    };
+
+    // Completion queries against 5000 options and 200 commands, the way a
+    // shell asks them on every tab, next to parsing the same words
+    template<class P>
+    void completion(const char *_impl) {
+        P p("bench");
+        for(std::size_t i = 0; i < 5000; ++i) {
+            p.addOption("option-"+std::to_string(i), "An option");
+        }
+        for(std::size_t i = 0; i < 200; ++i) {
+            p.addCommand("command-"+std::to_string(i), "A command");
+        }
+        // --option-123 and --option-1230 to --option-1239, command-15 and command-150 to command-159
+        std::vector<std::string> option = {"__complete", "--option-123"};
+        std::vector<std::string> command = {"__complete", "--option-7", "x", "command-15"};
+        std::vector<std::string> parsed = {"--option-7", "x", "command-15"};
+        LineCounter counter;
+        std::ostream out(&counter);
+        std::size_t mismatches = 0;
+        std::size_t r = 20000;
+        std::size_t before = allocations;
+        double start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            counter.lines = 0;
+            if(!p.complete(option, out) || counter.lines != 11) {
+                ++mismatches;
+            }
+        }
+        double elapsed = now()-start;
+        std::size_t allocated = allocations-before;
+        report("complete opt", _impl, 5000, elapsed/r, 1, "query", double(allocated)/r);
+
+        before = allocations;
+        start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            counter.lines = 0;
+            if(!p.complete(command, out) || counter.lines != 11) {
+                ++mismatches;
+            }
+        }
+        elapsed = now()-start;
+        allocated += allocations-before;
+        report("complete cmd", _impl, 200, elapsed/r, 1, "query", double(allocations-before)/r);
+
+        decltype(p.parse(parsed)) results;
+        p.parseInto(parsed, results);
+        before = allocations;
+        start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            p.parseInto(parsed, results);
+        }
+        elapsed = now()-start;
+        report("parse words", _impl, 5000, elapsed/r, 1, "query", double(allocations-before)/r);
+
+        if(mismatches != 0 || allocated != 0) {
+            std::printf("completion: %zu mismatches, %zu allocations\n", mismatches, allocated);
+            ++failures;
+        }
+    }
+
+    // A console with 200 commands, each with a handler. dispatch goes straight
+    // to the handler of the parsed command; the baseline compares the command
+    // against every name in turn, the way a hand-written if-else chain would.
+    template<class P>
+    void dispatch(const char *_impl) {
+        P p("bench");
+        std::vector<std::string> args = {"command-150"};
+        decltype(p.parse(args)) results;
+        using R = decltype(results);
+        std::vector<std::string> names;
+        int hits = 0;
+        for(std::size_t c = 0; c < 200; ++c) {
+            names.push_back("command-"+std::to_string(c));
+            p.addCommand(names.back(), "A command", [&hits, c](const R &) {
+                hits += int(c);
+                return 0;
+            });
+        }
+        p.parseInto(args, results);
+        std::size_t mismatches = 0;
+        std::size_t before = allocations;
+        std::size_t r = 20000;
+        double start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            p.parseInto(args, results);
+            hits = 0;
+            if(p.dispatch(results) != 0 || hits != 150) {
+                ++mismatches;
+            }
+        }
+        double elapsed = now()-start;
+        std::size_t allocated = allocations-before;
+        report("dispatch", _impl, 1, elapsed/r, 1, "cmd", double(allocated)/r);
+
+        start = now();
+        for(std::size_t i = 0; i < r; ++i) {
+            p.parseInto(args, results);
+            hits = 0;
+            for(std::size_t c = 0; c < names.size(); ++c) {
+                if(results.command == names[c]) {
+                    hits += int(c);
+                    break;
+                }
+            }
+            if(hits != 150) {
+                ++mismatches;
+            }
+        }
+        elapsed = now()-start;
+        report("if-else chain", _impl, 1, elapsed/r, 1, "cmd", 0);
+
+        if(mismatches != 0 || allocated != 0) {
+            std::printf("dispatch: %zu mismatches, %zu allocations\n", mismatches, allocated);
+            ++failures;
+        }
+    }
+
+    // repl has to report a line that does not parse, a command without a
+    // handler, an unterminated quote and a handler that throws, and go on
+    template<class P>
+    void repl(const char *_impl) {
+        P p("bench");
+        std::string added;
+        using R = decltype(p.parse(std::vector<std::string>()));
+        p.addCommand("add", "Add things", [&added](const R &_r) {
+            for(const auto &arg : _r.positional) {
+                added += arg+";";
+            }
+            return 0;
+        });
+        p.addCommand("fail", "Throw", [](const R &) -> int {
+            throw std::runtime_error("boom");
+        });
+        p.addCommand("plain", "No handler");
+        std::istringstream in("add one\n--bogus\nplain\nadd 'open\nfail\n\nadd 'two words' three\n");
+        std::ostringstream out;
+        int status = p.repl(in, out);
+        std::vector<std::string> lines;
+        std::istringstream written(out.str());
+        for(std::string line; std::getline(written, line);) {
+            lines.push_back(line);
+        }
+        if(status != 0 || added != "one;two words;three;" || lines.size() != 4 || lines[0].empty() || lines[1].empty() || lines[2] != "unterminated quote" || lines[3] != "boom") {
+            std::printf("repl (%s): status %d, added \"%s\", %zu error lines\n", _impl, status, added.c_str(), lines.size());
+            ++failures;
+        }
+    }
+
+    inline void writeFile(const char *_path, const char *_text) {
+        std::FILE *f = std::fopen(_path, "wb");
+        if(f != nullptr) {
+            std::fputs(_text, f);
+            std::fclose(f);
+        }
+    }
+
+    // Quotes, escapes and nested files have to be read the way a shell would
+    // split them, and a file that cannot be read has to name itself in the
+    // error
+    template<class P, class F>
+    void responseFileSyntax() {
+        P p("bench");
+        p.response_files = true;
+        writeFile("args_bench_outer.rsp", "'single  quoted' \"double \\\"quoted\\\"\"\n back\\ slash @args_bench_inner.rsp\tlast");
+        writeFile("args_bench_inner.rsp", "nested");
+        writeFile("args_bench_self.rsp", "x @args_bench_self.rsp");
+        writeFile("args_bench_open.rsp", "fine 'open");
+        const std::vector<std::string> expected = {"first", "single  quoted", "double \"quoted\"", "back slash", "nested", "last"};
+        bool ok = p.parse(std::vector<std::string>{"first", "@args_bench_outer.rsp"}).positional == expected;
+        struct bad {
+            const char *arg;
+            const char *file;
+            const char *reason;
+        };
+        const bad errors[] = {
+            {"@args_bench_self.rsp", "args_bench_self.rsp", "it includes itself"},
+            {"@args_bench_open.rsp", "args_bench_open.rsp", "unterminated quote"},
+            {"@args_bench_missing.rsp", "args_bench_missing.rsp", ""}
+        };
+        for(const bad &b : errors) {
+            try {
+                p.parse(std::vector<std::string>{b.arg});
+                ok = false;
+            }catch(F &e) {
+                const std::string what = e.what();
+                ok = ok && std::string(e.which()) == b.file && what.find(b.reason) != std::string::npos;
+            }
+        }
+        for(const char *path : {"args_bench_outer.rsp", "args_bench_inner.rsp", "args_bench_self.rsp", "args_bench_open.rsp"}) {
+            std::remove(path);
+        }
+        if(!ok) {
+            std::puts("@file: quoting or errors differ");
+            ++failures;
+        }
+    }
+
+    // The corpus read from a response file has to give the same positionals as
+    // the corpus passed in argv
+    template<class P, class V>
+    void responseFiles(const char *_impl) {
+        P p("bench");
+        schema(p);
+        p.response_files = true;
+        const char *path = "args_bench.rsp";
+        const char *argv[] = {"@args_bench.rsp"};
+        for(std::size_t n : {1000, 100000, 1000000}) {
+            Corpus c(n);
+            c.write(path);
+            const auto expected = p.parseView(c.argv.data(), c.argv.size());
+            std::size_t r = reps(n);
+            std::size_t mismatches = 0;
+            std::size_t before = allocations;
+            double start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                Counter<V> counter;
+                p.visit(argv, 1, counter);
+                if(counter.positionals != expected.positional.size()) {
+                    ++mismatches;
+                }
+            }
+            double elapsed = now()-start;
+            report("@file visit", _impl, n, elapsed/r, n, "token", double(allocations-before)/r);
+
+            before = allocations;
+            start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                auto results = p.parseView(argv, 1);
+                if(results.positional != expected.positional || results.command != expected.command) {
+                    ++mismatches;
+                }
+            }
+            elapsed = now()-start;
+            report("@file parseView", _impl, n, elapsed/r, n, "token", double(allocations-before)/r);
+
+            if(mismatches != 0) {
+                std::printf("@file: %zu mismatches\n", mismatches);
+                ++failures;
+            }
+        }
+        std::remove(path);
+    }
+
+    template<class P>
+    void help(const char *_impl) {
+        for(std::size_t n : {100, 1000, 3000}) {
+            Names names(n);
+            P p("bench", "A parser with a very large schema, used to measure how long it takes to render the usage text");
+            for(std::size_t j = 0; j < names.flags.size(); ++j) {
+                p.addFlag(names.flags[j], names.help, j < 26 ? char('a'+j) : '\0');
+            }
+            for(std::size_t j = 0; j < names.options.size(); ++j) {
+                p.addOption(names.options[j], names.help, j < 26 ? char('A'+j) : '\0', "", {"one", "two", "three"});
+            }
+            for(std::size_t j = 0; j < names.commands.size(); ++j) {
+                p.addCommand(names.commands[j], names.help);
+            }
+            std::size_t r = reps(n*200);
+            std::size_t length = 0;
+            std::size_t before = allocations;
+            double start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                // a different width every time, so it is laid out again
+                p.max_line_length = 80+i%2;
+                length += p.help().length();
+            }
+            double elapsed = now()-start;
+            report("help render", _impl, n, elapsed/r, n, "def", double(allocations-before)/r);
+
+            before = allocations;
+            start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                length += p.help().length();
+            }
+            elapsed = now()-start;
+            report("help", _impl, n, elapsed/r, n, "def", double(allocations-before)/r);
+
+            std::vector<char> buffer(p.help(nullptr, 0)+1);
+            before = allocations;
+            start = now();
+            for(std::size_t i = 0; i < r; ++i) {
+                length += p.help(buffer.data(), buffer.size());
+            }
+            elapsed = now()-start;
+            report("help buffer", _impl, n, elapsed/r, n, "def", double(allocations-before)/r);
+            if(length == 0 || buffer[buffer.size()-1] != '\0') {
+                std::puts("unexpected result");
+                ++failures;
+            }
+        }
+    }
+
+    // Many threads parsing with one frozen parser, every result is checked
+    // against the one produced by a single thread
+    template<class P>
+    void concurrent(const char *_impl) {
+        P p("bench");
+        schema(p);
+        const auto frozen = p.freeze();
+        Corpus c(1000);
+        const auto expected = frozen.parse(c.argv.data(), c.argv.size());
+        // every form of help writes the text rendered by freeze
+        std::ostringstream streamed;
+        frozen.help(streamed);
+        std::vector<char> buffer(frozen.help(nullptr, 0)+1);
+        frozen.help(buffer.data(), buffer.size());
+        if(streamed.str() != frozen.help() || std::string(buffer.data()) != frozen.help()) {
+            std::puts("frozen help differs");
+            ++failures;
+        }
+
+        for(std::size_t threads : {1, 4, 16, 64}) {
+            std::size_t r = reps(c.argv.size()*threads);
+            std::vector<std::size_t> mismatches(threads, 0);
+            std::vector<std::thread> pool;
+            double start = now();
+            for(std::size_t t = 0; t < threads; ++t) {
+                pool.emplace_back([&, t]() {
+                    for(std::size_t i = 0; i < r; ++i) {
+                        auto results = frozen.parse(c.argv.data(), c.argv.size());
+                        auto view = frozen.parseView(c.argv.data(), c.argv.size());
+                        for(std::size_t o = 0; o < results.option.size(); ++o) {
+                            if(results.option[o] != expected.option[o] || view.option[o] != expected.option[o]) {
+                                ++mismatches[t];
+                            }
+                        }
+                        for(std::size_t f = 0; f < results.flag.size(); ++f) {
+                            if(results.flag[f] != expected.flag[f] || view.flag[f] != expected.flag[f]) {
+                                ++mismatches[t];
+                            }
+                        }
+                        if(results.positional != expected.positional || view.positional.size() != expected.positional.size() || results.command != expected.command || frozen.help().empty()) {
+                            ++mismatches[t];
+                        }
+                    }
+                });
+            }
+            for(auto &t : pool) {
+                t.join();
+            }
+            double elapsed = now()-start;
+            for(std::size_t m : mismatches) {
+                failures += m;
+            }
+            report("threads", _impl, threads, elapsed/r, c.argv.size()*threads*2, "token", 0);
+        }
+    }
+
+    // Many short command lines, one at a time and with parseBatch
+    template<class P>
+    void batch(const char *_impl) {
+        P p("bench");
+        schema(p);
+        const auto frozen = p.freeze();
+        std::vector<std::vector<std::string>> lines;
+        for(std::size_t i = 0; i < 100000; ++i) {
+            Corpus c(8+i%8);
+            lines.push_back(c.storage);
+            if(i%1000 == 0) {
+                lines.back().push_back("--unknown");
+            }
+        }
+        std::size_t tokens = 0;
+        for(const auto &l : lines) {
+            tokens += l.size();
+        }
+
+        std::size_t errors = 0;
+        double start = now();
+        for(const auto &l : lines) {
+            try {
+                frozen.parse(l);
+            }catch(...) {
+                ++errors;
+            }
+        }
+        double elapsed = now()-start;
+        report("serial", _impl, lines.size(), elapsed, tokens, "token", 0);
+
+        start = now();
+        auto results = frozen.parseBatch(lines);
+        elapsed = now()-start;
+        report("batch", _impl, lines.size(), elapsed, tokens, "token", 0);
+
+        for(std::size_t i = 0; i < results.size(); ++i) {
+            if(results[i].ok() == (i%1000 == 0) || (results[i].ok() && results[i].results.positional.empty())) {
+                ++failures;
+            }
+        }
+        if(errors != lines.size()/1000) {
+            ++failures;
+        }
+    }
+
+    // I names the types of one implementation, see compiled.cpp
+    template<class I>
+    void run(const char *_impl) {
+        using P = typename I::parser;
+        using V = typename I::visitor;
+        using K = typename I::value_kind;
+        using D = typename I::duplicate_keys;
+        using T = typename I::spec;
+        using E = typename I::invalid_argument;
+        staticSchema<P, I::template schema, T>(_impl);
+        tokens<I>(_impl);
+        registration<P, I::template schema, T>(_impl);
+        footprint<P>(_impl);
+        parsing<P, I::template schema, T>(_impl);
+        streaming<P, V>(_impl);
+        arena<P>(_impl);
+        typedValues<P, K>(_impl);
+        conversions<P, K, typename I::invalid_value, typename I::missing_value>(_impl);
+        allowedValues<P>(_impl);
+        repeated<P>(_impl);
+        lists<P>(_impl);
+        maps<P, typename I::invalid_value>(_impl);
+        environment<P, D>(_impl);
+        config<P, D>(_impl);
+        subcommands<P>(_impl);
+        ambiguousPrefixes<P, typename I::ambiguous_argument, E>();
+        prefixes<P>(_impl);
+        suggestions<P, E>(_impl);
+        completion<P>(_impl);
+        dispatch<P>(_impl);
+        repl<P>(_impl);
+        responseFileSyntax<P, typename I::response_file_error>();
+        responseFiles<P, V>(_impl);
+        help<P>(_impl);
+        concurrent<P>(_impl);
+        batch<P>(_impl);
+    }
+
+    void runCompiled();
+    void runHeader();
+}
@@ -0,0 +1,29 @@
+#include "../headers/args.h"
+#include "bench.h"
+
+namespace {
+    // What the benchmarks need from one implementation
+    struct Compiled {
+        using parser = ArgParser;
+        using visitor = ArgVisitor;
+        using value_kind = args::value_kind;
+        using duplicate_keys = args::duplicate_keys;
+        using spec = args::spec;
+        template<std::size_t N>
+        using schema = args::schema<N>;
+        using token_kind = args::token_kind;
+        using invalid_argument = args::invalid_argument;
+        using invalid_value = args::invalid_value;
+        using missing_value = args::missing_value;
+        using response_file_error = args::response_file_error;
+        using ambiguous_argument = args::ambiguous_argument;
+
+        static args::token classify(std::string_view _arg) {
+            return args::classify(_arg);
+        }
+    };
+}
+
+void bench::runCompiled() {
+    run<Compiled>("args.cpp");
+}
@@ -0,0 +1,77 @@
+// Hargs.h defines the same class names as args.h, so it is put in its own
+// namespace here to be able to link both into one binary. Everything it
+// includes has to be pulled in first, outside of that namespace.
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <ostream>
+#include <istream>
+#include <memory_resource>
+#include <chrono>
+#include <mutex>
+#include <charconv>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <deque>
+#include <sstream>
+#include <cctype>
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <stdlib.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #ifdef __APPLE__
+        #include <crt_externs.h>
+    #endif
+#endif
+#include "bench.h"
+
+namespace hargs {
+    #include "../headers/Hargs.h"
+}
+
+namespace {
+    // What the benchmarks need from one implementation
+    struct Header {
+        using parser = hargs::ArgParser;
+        using visitor = hargs::ArgVisitor;
+        using value_kind = hargs::args::value_kind;
+        using duplicate_keys = hargs::args::duplicate_keys;
+        using spec = hargs::args::spec;
+        template<std::size_t N>
+        using schema = hargs::args::schema<N>;
+        using token_kind = hargs::args::token_kind;
+        using invalid_argument = hargs::args::invalid_argument;
+        using invalid_value = hargs::args::invalid_value;
+        using missing_value = hargs::args::missing_value;
+        using response_file_error = hargs::args::response_file_error;
+        using ambiguous_argument = hargs::args::ambiguous_argument;
+
+        static hargs::args::token classify(std::string_view _arg) {
+            return hargs::args::classify(_arg);
+        }
+    };
+}
+
+void bench::runHeader() {
+    run<Header>("Hargs.h");
+}
@@ -1,21 +1,34 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <regex>
+#include <memory>
+#include <cstdint>
+#include <exception>
+#include <functional>
 #include <cstring>
 #include <cerrno>
+#include <ostream>
+#include <istream>
+#include <memory_resource>
+#include <chrono>
+#include <mutex>
+#include <atomic>
 
 namespace args {
     class invalid_argument : public std::exception {
         private:
             std::string arg;
+            std::vector<std::string> similar;
             std::string error;
 
         public:
-            invalid_argument(const std::string &_arg);
+            // _suggestions are known names close to _arg, the closest first
+            invalid_argument(const std::string &_arg, const std::vector<std::string> &_suggestions = {});
             virtual const char* what() const throw();
             const char* which();
+            const std::vector<std::string>& suggestions();
     };
 
     class invalid_value : public std::exception {
@@ -52,94 +65,1608 @@ namespace args {
             virtual const char* what() const throw();
             const char* which();
     };
+
+    class response_file_error : public std::exception {
+        private:
+            std::string file;
+            std::string error;
+
+        public:
+            response_file_error(const std::string &_file, const std::string &_reason);
+            virtual const char* what() const throw();
+            const char* which();
+    };
+
+    class config_error : public std::exception {
+        private:
+            std::string file;
+            std::string error;
+
+        public:
+            config_error(const std::string &_file, const std::string &_reason);
+            virtual const char* what() const throw();
+            const char* which();
+    };
+
+    class no_handler : public std::exception {
+        private:
+            std::string command;
+            std::string error;
+
+        public:
+            // _command is empty if no command was given
+            no_handler(const std::string &_command);
+            virtual const char* what() const throw();
+            const char* which();
+    };
+
+    class ambiguous_argument : public std::exception {
+        private:
+            std::string arg;
+            std::vector<std::string> matches;
+            std::string error;
+
+        public:
+            // _matches are the names starting with _arg, in sorted order
+            ambiguous_argument(const std::string &_arg, const std::vector<std::string> &_matches);
+            virtual const char* what() const throw();
+            const char* which();
+            const std::vector<std::string>& candidates();
+    };
+
+    enum class token_kind {
+        empty,
+        short_cluster,
+        long_option,
+        long_value,
+        word
+    };
+
+    // Position of the first '=' is relative to the whole argument
+    struct token {
+        token_kind kind;
+        std::size_t equals;
+    };
+
+    token classify(std::string_view _arg);
+
+    // What an option's value is converted to while parsing. string options are
+    // kept as they are; choice options must be one of allowed and give its index.
+    enum class value_kind {
+        string,
+        integer,
+        real,
+        boolean,
+        duration,
+        size,
+        choice
+    };
+
+    // What a map option does with a key that is given again
+    enum class duplicate_keys {
+        last_wins,
+        first_wins,
+        error
+    };
+
+    // Shells ArgParser::completion writes scripts for
+    enum class shell {
+        bash,
+        zsh,
+        fish
+    };
+
+    // Native form of a typed value. integer holds the whole number, the
+    // nanoseconds of a duration, the bytes of a size, 0 or 1 for a boolean and
+    // the index of a choice; real holds the same value as a double.
+    struct typed_value {
+        std::int64_t integer;
+        double real;
+    };
+
+    // Converts _value with std::from_chars, false if it is malformed, out of
+    // range or not finite. Sizes take a K, M, G or T suffix (powers of 1024,
+    // optionally followed by B or iB), durations are one or more numbers each
+    // followed by ns, us, ms, s, m, h or d, or a single number of seconds.
+    bool convert(const value_kind _kind, std::string_view _value, typed_value &_out);
 }
 
+// Bytes of heap memory a parser holds, not counting allocator overhead
+class ArgFootprint {
+    public:
+        std::size_t names = 0;
+        std::size_t definitions = 0;
+        std::size_t indexes = 0;
+        std::size_t help = 0;
+
+        std::size_t total() const;
+
+        template<class S>
+        static std::size_t of(const S &_s) {
+            // short strings are kept inside the object itself
+            const char *data = _s.data();
+            const char *object = reinterpret_cast<const char*>(&_s);
+            return data >= object && data < object+sizeof(_s) ? 0 : _s.capacity()+1;
+        }
+};
+
+// Interned names. Each one is stored once, back to back in a single buffer,
+// and is known by its position: the handle of the flag or option it names.
+class ArgNames {
+    private:
+        std::pmr::string pool;
+        std::pmr::vector<std::size_t> ends;
+        // open addressing, handle+1 or 0 for an empty slot
+        std::pmr::vector<std::uint32_t> slots;
+
+        void rehash(const std::size_t _slots);
+
+    public:
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+        ArgNames(const allocator_type &_alloc = {});
+        ArgNames(const ArgNames &_other, const allocator_type &_alloc = {});
+        ArgNames(ArgNames &&_other) = default;
+        ArgNames &operator=(const ArgNames &_other) = default;
+
+        std::size_t add(std::string_view _name);
+        std::size_t find(std::string_view _name) const;
+        std::string_view operator[](const std::size_t _handle) const;
+        std::size_t size() const;
+        bool empty() const;
+        std::size_t footprint() const;
+};
+
+// Allowed values kept in a file, read the first time an option needs them.
+// The file is split into values like a response file is split into arguments.
+class ArgAllowedFile {
+    public:
+        const std::string path;
+        ArgNames values;
+        std::mutex loading;
+        std::atomic<bool> loaded{false};
+
+        ArgAllowedFile(const std::string &_path, const ArgNames::allocator_type &_alloc = {});
+};
+
+class ArgParser;
+class ArgResults;
+
+// A command with flags and options of its own. Its parser is made by factory
+// the first time a command line enters the command, and then kept.
+class ArgSubcommand {
+    public:
+        const std::function<void(ArgParser &)> factory;
+        std::shared_ptr<const ArgParser> parser;
+        std::mutex building;
+        std::atomic<bool> built{false};
+
+        ArgSubcommand(std::function<void(ArgParser &)> _factory);
+};
+
+class ArgCommand {
+    public:
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        std::pmr::string help;
+        // set if the command has flags and options of its own
+        std::shared_ptr<ArgSubcommand> scope;
+        // what dispatch runs for it, if anything
+        std::function<int(const ArgResults &)> handler;
+
+        ArgCommand(std::string_view _help, const allocator_type &_alloc = {});
+        ArgCommand(const ArgCommand &_other, const allocator_type &_alloc = {});
+        ArgCommand(ArgCommand &&_other) = default;
+        ArgCommand(ArgCommand &&_other, const allocator_type &_alloc);
+        ArgCommand &operator=(const ArgCommand &_other) = default;
+};
+
+// Definitions take their memory from the parser's std::pmr::memory_resource
 class ArgFlag {
     public:
-        std::string help;
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        std::pmr::string help;
+        char abbr = '\0';
+        // index+1 of its count in the results, 0 if it is not counted
+        std::uint32_t counter = 0;
+        // index+1 of the environment variable it falls back on, 0 if none
+        std::uint32_t env = 0;
 
-        ArgFlag(const std::string &_help);
+        ArgFlag(std::string_view _help, const allocator_type &_alloc = {});
+        ArgFlag(const ArgFlag &_other, const allocator_type &_alloc = {});
+        ArgFlag(ArgFlag &&_other) = default;
+        ArgFlag(ArgFlag &&_other, const allocator_type &_alloc);
+        ArgFlag &operator=(const ArgFlag &_other) = default;
 };
 
 class ArgOption {
     public:
-        std::string help;
-        std::string defaults_to;
-        std::vector<std::string> allowed;
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        std::pmr::string help;
+        std::pmr::string defaults_to;
+        ArgNames allowed;
+        // replaces allowed when set
+        std::shared_ptr<ArgAllowedFile> allowed_file;
+        char abbr = '\0';
+        // every value is kept, not only the last one
+        bool repeated = false;
+        // splits the value into a list, '\0' for a single value
+        char delimiter = '\0';
+        // values are key=value pairs collected in results.map
+        bool map = false;
+        args::duplicate_keys duplicates = args::duplicate_keys::last_wins;
+        // index+1 of the environment variable it falls back on, 0 if none
+        std::uint32_t env = 0;
+        args::value_kind kind = args::value_kind::string;
+        // defaults_to converted to kind
+        args::typed_value typed_default = {};
+
+        ArgOption(std::string_view _help, std::string_view _defaults_to, const std::vector<std::string> &_allowed, const allocator_type &_alloc = {});
+        ArgOption(const ArgOption &_other, const allocator_type &_alloc = {});
+        ArgOption(ArgOption &&_other) = default;
+        ArgOption(ArgOption &&_other, const allocator_type &_alloc);
+        ArgOption &operator=(const ArgOption &_other) = default;
+};
+
+// Everything a parser knows about its arguments, shared with the results it
+// produces so they can still be read by name after the parser is gone
+class ArgDefinitions {
+    public:
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        ArgNames flag_names;
+        std::pmr::vector<ArgFlag> flags;
+        ArgNames option_names;
+        std::pmr::vector<ArgOption> options;
+        // handle+1 of the flag or option each character abbreviates, 0 if none
+        std::uint32_t flags_abbr[256] = {};
+        std::uint32_t options_abbr[256] = {};
+        ArgNames command_names;
+        std::pmr::vector<ArgCommand> commands;
+        // number of counting flags
+        std::size_t counters = 0;
+        // number of map options
+        std::size_t maps = 0;
+        // environment variables bound with bindEnv, and the flag (handle*2) or
+        // option (handle*2+1) each one sets
+        ArgNames env;
+        std::pmr::vector<std::uint32_t> env_targets;
+        // every flag (handle*2) and option (handle*2+1) in the order of their
+        // names, so the names starting with a prefix are next to each other
+        std::pmr::vector<std::uint32_t> long_names;
+        // every command in the order of its name, the same way
+        std::pmr::vector<std::uint32_t> command_order;
+
+        static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+        ArgDefinitions(const allocator_type &_alloc = {});
+        ArgDefinitions(const ArgDefinitions &_other, const allocator_type &_alloc = {});
+        allocator_type get_allocator() const;
+
+        std::size_t findFlag(std::string_view _name) const;
+        std::size_t findOption(std::string_view _name) const;
+        std::size_t findFlagAbbr(std::string_view _abbr) const;
+        std::size_t findOptionAbbr(std::string_view _abbr) const;
+        std::size_t findCommand(std::string_view _name) const;
+        std::string_view longName(const std::size_t _target) const;
+        // Adds the flag or option _target to long_names, after its name is added
+        void index(const std::size_t _target);
+        // Positions [first, second) in long_names of the names starting with _prefix
+        std::pair<std::size_t, std::size_t> prefixed(std::string_view _prefix) const;
+        // The flag (handle*2) or option (handle*2+1) that is the only one whose
+        // name starts with _prefix, npos if there is none; throws
+        // args::ambiguous_argument if there are more
+        std::size_t findPrefix(std::string_view _prefix) const;
+        // Adds the command _handle to command_order, after its name is added
+        void indexCommand(const std::size_t _handle);
+        // Positions [first, second) in command_order of the commands starting with _prefix
+        std::pair<std::size_t, std::size_t> prefixedCommands(std::string_view _prefix) const;
+};
+
+class ArgFlagValues {
+    private:
+        std::pmr::vector<std::uint64_t> bits;
+        // occurrences of the counting flags
+        std::pmr::vector<std::uint32_t> counts;
+        // layer (command line, config file, environment) each count comes from
+        std::pmr::vector<std::uint8_t> layers;
+        std::shared_ptr<const ArgDefinitions> defs;
+
+        friend class ArgParser;
+        friend class ArgResults;
+        friend class ArgResultsView;
+
+        // A count from another layer is dropped, not added to
+        void set(const std::size_t _handle, const std::uint8_t _layer = 0) {
+            bits[_handle/64] |= std::uint64_t(1) << (_handle%64);
+            std::uint32_t counter = defs->flags[_handle].counter;
+            if(counter != 0) {
+                if(layers[counter-1] != _layer) {
+                    layers[counter-1] = _layer;
+                    counts[counter-1] = 0;
+                }
+                ++counts[counter-1];
+            }
+        }
+
+    public:
+        ArgFlagValues(const std::pmr::polymorphic_allocator<char> &_alloc = {}) : bits(_alloc), counts(_alloc), layers(_alloc) {}
+
+        bool operator[](const std::size_t _handle) const {
+            return _handle/64 < bits.size() && (bits[_handle/64] >> (_handle%64)) & 1;
+        }
+
+        bool operator[](std::string_view _name) const {
+            return defs != nullptr && (*this)[defs->findFlag(_name)];
+        }
+
+        // How many times a flag was given; at most 1 unless it was added with addCounter
+        std::size_t count(const std::size_t _handle) const {
+            if(_handle < size() && defs->flags[_handle].counter != 0) {
+                return counts[defs->flags[_handle].counter-1];
+            }
+            return (*this)[_handle] ? 1 : 0;
+        }
+
+        std::size_t count(std::string_view _name) const {
+            return defs != nullptr ? count(defs->findFlag(_name)) : 0;
+        }
+
+        std::size_t size() const {
+            return defs != nullptr ? defs->flags.size() : 0;
+        }
+};
+
+// Where one element of a list option is in its value
+struct ArgSlice {
+    std::uint32_t offset;
+    std::uint32_t length;
+};
+
+// The elements of a list option, string_views into its value
+class ArgList {
+    private:
+        std::string_view value;
+        const ArgSlice *first;
+        const ArgSlice *last;
+
+    public:
+        class iterator {
+            private:
+                std::string_view value;
+                const ArgSlice *slice;
+
+            public:
+                iterator(std::string_view _value, const ArgSlice *_slice) : value(_value), slice(_slice) {}
+
+                std::string_view operator*() const {
+                    return value.substr(slice->offset, slice->length);
+                }
+
+                iterator &operator++() {
+                    ++slice;
+                    return *this;
+                }
+
+                bool operator==(const iterator &_other) const {
+                    return slice == _other.slice;
+                }
+
+                bool operator!=(const iterator &_other) const {
+                    return slice != _other.slice;
+                }
+        };
+
+        ArgList(std::string_view _value = std::string_view(), const ArgSlice *_first = nullptr, const ArgSlice *_last = nullptr) : value(_value), first(_first), last(_last) {}
+
+        iterator begin() const {
+            return iterator(value, first);
+        }
+
+        iterator end() const {
+            return iterator(value, last);
+        }
+
+        std::string_view operator[](const std::size_t _i) const {
+            return value.substr(first[_i].offset, first[_i].length);
+        }
+
+        std::size_t size() const {
+            return last-first;
+        }
+
+        bool empty() const {
+            return first == last;
+        }
+};
+
+template<class S>
+class ArgOptionValues {
+    private:
+        std::pmr::vector<S> values;
+        // elements of the list options, as positions so they stay valid when
+        // the results are copied or moved
+        std::pmr::vector<ArgSlice> slices;
+        // the elements of option h are slices[starts[h]] to slices[starts[h+1]]
+        std::pmr::vector<std::uint32_t> starts;
+        std::shared_ptr<const ArgDefinitions> defs;
+
+        friend class ArgParser;
+        friend class ArgResults;
+        friend class ArgResultsView;
+
+        static const S &none() {
+            static const S empty;
+            return empty;
+        }
+
+    public:
+        ArgOptionValues(const std::pmr::polymorphic_allocator<char> &_alloc = {}) : values(_alloc), slices(_alloc), starts(_alloc) {}
+
+        const S &operator[](const std::size_t _handle) const {
+            return _handle < values.size() ? values[_handle] : none();
+        }
+
+        const S &operator[](std::string_view _name) const {
+            return defs != nullptr ? (*this)[defs->findOption(_name)] : none();
+        }
+
+        // Elements of an option added with addListOption, empty for any other
+        ArgList list(const std::size_t _handle) const {
+            if(_handle >= values.size()) {
+                return ArgList();
+            }
+            return ArgList(values[_handle], slices.data()+starts[_handle], slices.data()+starts[_handle+1]);
+        }
+
+        ArgList list(std::string_view _name) const {
+            return defs != nullptr ? list(defs->findOption(_name)) : ArgList();
+        }
+
+        std::size_t size() const {
+            return values.size();
+        }
+};
+
+// The values of one repeated option, in command line order
+template<class S>
+class ArgValueList {
+    private:
+        const S *first;
+        const S *last;
+
+    public:
+        ArgValueList(const S *_first = nullptr, const S *_last = nullptr) : first(_first), last(_last) {}
+
+        const S *begin() const {
+            return first;
+        }
+
+        const S *end() const {
+            return last;
+        }
+
+        const S &operator[](const std::size_t _i) const {
+            return first[_i];
+        }
+
+        std::size_t size() const {
+            return last-first;
+        }
+
+        bool empty() const {
+            return first == last;
+        }
+};
+
+// Every value of the repeated options, one buffer for all of them. Values are
+// appended as they come and copied into one run per option once parsing is
+// done. Both sides keep their buffers in place, so a reused results object
+// stops allocating after the first few command lines.
+template<class S>
+class ArgRepeatedValues {
+    private:
+        std::pmr::vector<S> values;
+        // option of each value before grouping
+        std::pmr::vector<std::uint32_t> handles;
+        // the values of option h are grouped[starts[h]] to grouped[starts[h+1]]
+        std::pmr::vector<std::uint32_t> starts;
+        std::pmr::vector<S> grouped;
+        // layer the values of each option come from
+        std::pmr::vector<std::uint8_t> layers;
+        std::size_t used = 0;
+        std::shared_ptr<const ArgDefinitions> defs;
+
+        friend class ArgParser;
+        friend class ArgResults;
+        friend class ArgResultsView;
+
+        void clear(const std::shared_ptr<const ArgDefinitions> &_defs) {
+            defs = _defs;
+            starts.assign(defs->options.size()+1, 0);
+            layers.assign(defs->options.size(), 0);
+            handles.clear();
+            used = 0;
+        }
+
+        // Values from another layer are dropped, not added to
+        void add(const std::size_t _handle, std::string_view _value, const std::uint8_t _layer = 0) {
+            if(!defs->options[_handle].repeated) {
+                return;
+            }
+            if(layers[_handle] != _layer) {
+                layers[_handle] = _layer;
+                drop(_handle);
+            }
+            if(used == values.size()) {
+                values.emplace_back();
+            }
+            if constexpr(std::is_same<S, std::string_view>::value) {
+                values[used] = _value;
+            }else {
+                values[used].assign(_value.data(), _value.size());
+            }
+            handles.push_back(static_cast<std::uint32_t>(_handle));
+            ++starts[_handle+1];
+            ++used;
+        }
+
+        // Removes the values of _handle, keeping the others in order
+        void drop(const std::size_t _handle) {
+            if(starts[_handle+1] == 0) {
+                return;
+            }
+            std::size_t kept = 0;
+            for(std::size_t i = 0; i < used; ++i) {
+                if(handles[i] != _handle) {
+                    std::swap(values[kept], values[i]);
+                    handles[kept++] = handles[i];
+                }
+            }
+            handles.resize(kept);
+            starts[_handle+1] = 0;
+            used = kept;
+        }
+
+        // counting sort by option, stable so each option keeps its order
+        void group() {
+            for(std::size_t h = 1; h < starts.size(); ++h) {
+                starts[h] += starts[h-1];
+            }
+            if(grouped.size() < used) {
+                grouped.resize(used);
+            }
+            for(std::size_t i = 0; i < used; ++i) {
+                S &grouped_value = grouped[starts[handles[i]]++];
+                if constexpr(std::is_same<S, std::string_view>::value) {
+                    grouped_value = values[i];
+                }else {
+                    grouped_value.assign(values[i].data(), values[i].size());
+                }
+            }
+            for(std::size_t h = starts.size()-1; h > 0; --h) {
+                starts[h] = starts[h-1];
+            }
+            starts[0] = 0;
+        }
+
+    public:
+        ArgRepeatedValues(const std::pmr::polymorphic_allocator<char> &_alloc = {}) : values(_alloc), handles(_alloc), starts(_alloc), grouped(_alloc), layers(_alloc) {}
+
+        ArgValueList<S> operator[](const std::size_t _handle) const {
+            if(_handle >= starts.size() || _handle+1 == starts.size()) {
+                return ArgValueList<S>();
+            }
+            return ArgValueList<S>(grouped.data()+starts[_handle], grouped.data()+starts[_handle+1]);
+        }
+
+        ArgValueList<S> operator[](std::string_view _name) const {
+            return defs != nullptr ? (*this)[defs->findOption(_name)] : ArgValueList<S>();
+        }
+};
+
+// The key=value pairs given to one map option, in the order the keys first
+// appeared. A key given without '=' has an empty value.
+template<class S>
+class ArgMap {
+    private:
+        const S *entries = nullptr;
+        const std::uint32_t *options = nullptr;
+        const std::uint32_t *keys = nullptr;
+        const std::uint32_t *slots = nullptr;
+        std::size_t mask = 0;
+        std::size_t used = 0;
+        std::size_t option = 0;
+        std::size_t count = 0;
+
+    public:
+        static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+        class iterator {
+            private:
+                const ArgMap *map;
+                std::size_t entry;
+
+                void skip() {
+                    while(entry < map->used && map->options[entry] != map->option) {
+                        ++entry;
+                    }
+                }
+
+            public:
+                iterator(const ArgMap *_map, const std::size_t _entry) : map(_map), entry(_entry) {
+                    skip();
+                }
+
+                std::pair<std::string_view, std::string_view> operator*() const {
+                    return {map->key(entry), map->value(entry)};
+                }
+
+                iterator &operator++() {
+                    ++entry;
+                    skip();
+                    return *this;
+                }
+
+                bool operator==(const iterator &_other) const {
+                    return entry == _other.entry;
+                }
+
+                bool operator!=(const iterator &_other) const {
+                    return entry != _other.entry;
+                }
+        };
+
+        ArgMap() {}
+
+        ArgMap(const S *_entries, const std::uint32_t *_options, const std::uint32_t *_keys, const std::uint32_t *_slots, const std::size_t _slot_count, const std::size_t _used, const std::size_t _option, const std::size_t _count) :
+            entries(_entries), options(_options), keys(_keys), slots(_slots), mask(_slot_count-1), used(_used), option(_option), count(_count) {}
+
+        // keys of different options share one table
+        static std::size_t hash(const std::size_t _option, std::string_view _key) {
+            return std::hash<std::string_view>()(_key)^(_option*0x9e3779b97f4a7c15ull);
+        }
+
+        std::string_view key(const std::size_t _entry) const {
+            return std::string_view(entries[_entry].data(), keys[_entry]);
+        }
+
+        std::string_view value(const std::size_t _entry) const {
+            std::string_view entry(entries[_entry].data(), entries[_entry].size());
+            return keys[_entry] < entry.size() ? entry.substr(keys[_entry]+1) : std::string_view();
+        }
+
+        // Entry of _key, npos if it was not given
+        std::size_t find(std::string_view _key) const {
+            if(count == 0) {
+                return npos;
+            }
+            for(std::size_t i = hash(option, _key) & mask; slots[i] != 0; i = (i+1) & mask) {
+                std::size_t entry = slots[i]-1;
+                if(options[entry] == option && key(entry) == _key) {
+                    return entry;
+                }
+            }
+            return npos;
+        }
+
+        bool contains(std::string_view _key) const {
+            return find(_key) != npos;
+        }
+
+        // Value of _key, empty if it was not given
+        std::string_view operator[](std::string_view _key) const {
+            std::size_t entry = find(_key);
+            return entry != npos ? value(entry) : std::string_view();
+        }
+
+        iterator begin() const {
+            return iterator(this, 0);
+        }
+
+        iterator end() const {
+            return iterator(this, used);
+        }
+
+        std::size_t size() const {
+            return count;
+        }
+
+        bool empty() const {
+            return count == 0;
+        }
+};
+
+// Every key=value pair of the map options, one table for all of them. Entries
+// are kept as they were given, views into the arguments for ArgResultsView,
+// and the table is sized from the number of arguments before parsing so it
+// only grows when response files add more.
+template<class S>
+class ArgMapValues {
+    private:
+        std::pmr::vector<S> entries;
+        // option of each entry and the length of its key
+        std::pmr::vector<std::uint32_t> options;
+        std::pmr::vector<std::uint32_t> keys;
+        // open addressing over option and key, entry+1 or 0 for an empty slot
+        std::pmr::vector<std::uint32_t> slots;
+        // entries of each option
+        std::pmr::vector<std::uint32_t> sizes;
+        // layer the entries of each option come from
+        std::pmr::vector<std::uint8_t> layers;
+        std::size_t used = 0;
+        std::shared_ptr<const ArgDefinitions> defs;
+
+        friend class ArgParser;
+        friend class ArgResults;
+        friend class ArgResultsView;
+
+        void place(const std::size_t _entry) {
+            const std::size_t mask = slots.size()-1;
+            std::size_t i = ArgMap<S>::hash(options[_entry], std::string_view(entries[_entry].data(), keys[_entry])) & mask;
+            while(slots[i] != 0) {
+                i = (i+1) & mask;
+            }
+            slots[i] = static_cast<std::uint32_t>(_entry+1);
+        }
+
+        void clear(const std::shared_ptr<const ArgDefinitions> &_defs, const std::size_t _args) {
+            defs = _defs;
+            options.clear();
+            keys.clear();
+            used = 0;
+            if(defs->maps == 0) {
+                slots.clear();
+                sizes.clear();
+                layers.clear();
+                return;
+            }
+            // at most one entry per argument, kept at most half full
+            std::size_t size = 16;
+            while(size < 2*_args) {
+                size <<= 1;
+            }
+            slots.assign(size, 0);
+            sizes.assign(defs->options.size(), 0);
+            layers.assign(defs->options.size(), 0);
+        }
+
+        // Entries from another layer are dropped, so a key given there does
+        // not count as a duplicate
+        void add(const std::size_t _handle, std::string_view _value, const std::uint8_t _layer = 0) {
+            const ArgOption &option = defs->options[_handle];
+            if(!option.map) {
+                return;
+            }
+            if(layers[_handle] != _layer) {
+                layers[_handle] = _layer;
+                drop(_handle);
+            }
+            std::string_view key = _value.substr(0, _value.find('='));
+            if(key.empty()) {
+                throw args::invalid_value(std::string(defs->option_names[_handle]), std::string(_value));
+            }
+            const std::size_t mask = slots.size()-1;
+            std::size_t i = ArgMap<S>::hash(_handle, key) & mask;
+            for(; slots[i] != 0; i = (i+1) & mask) {
+                std::size_t entry = slots[i]-1;
+                if(options[entry] != _handle || std::string_view(entries[entry].data(), keys[entry]) != key) {
+                    continue;
+                }
+                if(option.duplicates == args::duplicate_keys::error) {
+                    throw args::duplicate_argument(std::string(key));
+                }
+                if(option.duplicates == args::duplicate_keys::last_wins) {
+                    set(entry, _value);
+                }
+                return;
+            }
+
+            if(used == entries.size()) {
+                entries.emplace_back();
+            }
+            set(used, _value);
+            options.push_back(static_cast<std::uint32_t>(_handle));
+            keys.push_back(static_cast<std::uint32_t>(key.size()));
+            slots[i] = static_cast<std::uint32_t>(used+1);
+            ++sizes[_handle];
+            ++used;
+            if(2*used > slots.size()) {
+                slots.assign(2*slots.size(), 0);
+                for(std::size_t entry = 0; entry < used; ++entry) {
+                    place(entry);
+                }
+            }
+        }
+
+        // Removes the entries of _handle and places the others again
+        void drop(const std::size_t _handle) {
+            if(sizes[_handle] == 0) {
+                return;
+            }
+            std::size_t kept = 0;
+            for(std::size_t entry = 0; entry < used; ++entry) {
+                if(options[entry] != _handle) {
+                    std::swap(entries[kept], entries[entry]);
+                    options[kept] = options[entry];
+                    keys[kept++] = keys[entry];
+                }
+            }
+            options.resize(kept);
+            keys.resize(kept);
+            sizes[_handle] = 0;
+            used = kept;
+            slots.assign(slots.size(), 0);
+            for(std::size_t entry = 0; entry < used; ++entry) {
+                place(entry);
+            }
+        }
+
+        void set(const std::size_t _entry, std::string_view _value) {
+            if constexpr(std::is_same<S, std::string_view>::value) {
+                entries[_entry] = _value;
+            }else {
+                entries[_entry].assign(_value.data(), _value.size());
+            }
+        }
+
+    public:
+        ArgMapValues(const std::pmr::polymorphic_allocator<char> &_alloc = {}) : entries(_alloc), options(_alloc), keys(_alloc), slots(_alloc), sizes(_alloc), layers(_alloc) {}
+
+        ArgMap<S> operator[](const std::size_t _handle) const {
+            if(_handle >= sizes.size()) {
+                return ArgMap<S>();
+            }
+            return ArgMap<S>(entries.data(), options.data(), keys.data(), slots.data(), slots.size(), used, _handle, sizes[_handle]);
+        }
+
+        ArgMap<S> operator[](std::string_view _name) const {
+            return defs != nullptr ? (*this)[defs->findOption(_name)] : ArgMap<S>();
+        }
+};
+
+// Values of typed options, converted once while parsing, and the index of the
+// value of options with allowed values. Each getter is meant for options of
+// its own kind; an unknown option reads as 0.
+class ArgTypedValues {
+    private:
+        std::pmr::vector<args::typed_value> values;
+        std::shared_ptr<const ArgDefinitions> defs;
+
+        friend class ArgParser;
+        friend class ArgResults;
+        friend class ArgResultsView;
+
+        const args::typed_value &at(const std::size_t _handle) const {
+            static const args::typed_value zero = {};
+            return _handle < values.size() ? values[_handle] : zero;
+        }
+
+        const args::typed_value &at(std::string_view _name) const {
+            return at(defs != nullptr ? defs->findOption(_name) : ArgDefinitions::npos);
+        }
+
+    public:
+        ArgTypedValues(const std::pmr::polymorphic_allocator<char> &_alloc = {}) : values(_alloc) {}
+
+        template<class K>
+        std::int64_t integer(const K &_option) const {
+            return at(_option).integer;
+        }
+
+        template<class K>
+        double real(const K &_option) const {
+            return at(_option).real;
+        }
+
+        template<class K>
+        bool boolean(const K &_option) const {
+            return at(_option).integer != 0;
+        }
+
+        template<class K>
+        std::chrono::nanoseconds duration(const K &_option) const {
+            return std::chrono::nanoseconds(at(_option).integer);
+        }
 
-        ArgOption(const std::string &_help = "", const std::string &_defaults_to = "", const std::vector<std::string> &_allowed = {});
+        template<class K>
+        std::uint64_t bytes(const K &_option) const {
+            return static_cast<std::uint64_t>(at(_option).integer);
+        }
+
+        // Index in allowed, ArgDefinitions::npos if there is no value or the
+        // default is not one of them
+        template<class K>
+        std::size_t choice(const K &_option) const {
+            return static_cast<std::size_t>(at(_option).integer);
+        }
+
+        std::size_t size() const {
+            return values.size();
+        }
 };
 
 class ArgResults {
     public:
-        std::unordered_map<std::string, bool> flag;
-        std::unordered_map<std::string, std::string> option;
+        ArgFlagValues flag;
+        ArgOptionValues<std::string> option;
+        ArgTypedValues typed;
+        ArgRepeatedValues<std::string> repeated;
+        ArgMapValues<std::string> map;
         std::vector<std::string> positional;
         std::string command;
+        // What follows a command with its own flags and options, read with the
+        // names of that command; empty for other commands
+        std::shared_ptr<ArgResults> subcommand;
 
         ArgResults();
+        // Bytes of heap memory held, not counting allocator overhead
+        std::size_t footprint() const;
+
+    private:
+        // positional strings left over from an earlier, longer parse; parseInto
+        // hands them out again so their buffers are reused
+        std::vector<std::string> spare;
+        // of command, so dispatch does not look it up again
+        std::size_t command_handle = ArgDefinitions::npos;
+
+        friend class ArgParser;
+};
+
+class ArgResultsView {
+    public:
+        ArgFlagValues flag;
+        ArgOptionValues<std::string_view> option;
+        ArgTypedValues typed;
+        ArgRepeatedValues<std::string_view> repeated;
+        ArgMapValues<std::string_view> map;
+        std::vector<std::string_view> positional;
+        std::string_view command;
+        std::shared_ptr<ArgResultsView> subcommand;
+
+        ArgResultsView();
+        std::size_t footprint() const;
+
+    private:
+        // response files the views point into
+        std::vector<std::shared_ptr<const void>> files;
+
+        friend class ArgParser;
 };
 
+// ArgResults that takes all of its memory from one std::pmr::memory_resource,
+// e.g. a std::pmr::monotonic_buffer_resource that is released in one go
+class ArgPmrResults {
+    public:
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        ArgFlagValues flag;
+        ArgOptionValues<std::pmr::string> option;
+        ArgTypedValues typed;
+        ArgRepeatedValues<std::pmr::string> repeated;
+        ArgMapValues<std::pmr::string> map;
+        std::pmr::vector<std::pmr::string> positional;
+        std::pmr::string command;
+        std::shared_ptr<ArgPmrResults> subcommand;
+
+        ArgPmrResults(const allocator_type &_alloc = {});
+};
+
+class ArgBatchResult {
+    public:
+        ArgResults results;
+        std::exception_ptr error;
+
+        bool ok() const;
+};
+
+// Receives the arguments from ArgParser::visit one at a time, in command line
+// order, as soon as each one is recognized. Options that are not given are not
+// reported, and the string_views point into the arguments passed to visit.
+class ArgVisitor {
+    public:
+        virtual ~ArgVisitor();
+        virtual void flag(const std::size_t _handle);
+        virtual void option(const std::size_t _handle, std::string_view _value);
+        // Follows option for typed options and options with allowed values,
+        // with the converted value or the index of the allowed value
+        virtual void typed(const std::size_t _handle, const args::typed_value &_value);
+        virtual void positional(std::string_view _arg);
+        // After a command with its own flags and options, the handles refer to
+        // the definitions of that command
+        virtual void command(std::string_view _arg);
+};
+
+class ArgFrozenParser;
+
 class ArgParser {
     private:
-        std::unordered_map<std::string, ArgFlag*> flags;
-        std::unordered_map<std::string, std::string> flags_abbr;
-        std::unordered_map<std::string, ArgOption*> options;
-        std::unordered_map<std::string, std::string> options_abbr;
-        std::unordered_map<std::string, std::string> commands;
+        std::shared_ptr<ArgDefinitions> defs;
         std::vector<std::string> positional;
         std::string name;
         std::string description;
 
-        bool validateOption(const std::vector<std::string> &_a, std::string _sa, std::size_t &_i, ArgResults &_r);
-        bool validateFlag(const std::string &_sa, ArgResults &_r);
-        std::string findFlagAbbr(const std::string &_name);
-        std::string findOptionAbbr(const std::string &_name);
-        void splitDesc(std::string &_help, std::string &_desc);
+        class HelpText;
+        class NameIndex;
+        class ResponseFile;
+        class ConfigFile;
+        class Source;
+        class ResultsSink;
+        class ViewSink;
+        class PmrSink;
+
+        // rendered help, dropped by add* and redone if max_line_length changes
+        mutable std::shared_ptr<const HelpText> help_cache;
+        // made the first time a name is not found, dropped by add*
+        mutable std::shared_ptr<const NameIndex> name_index;
+        // swapped whole by reloadConfig, while other threads may be parsing
+        std::shared_ptr<const ConfigFile> config;
+        bool has_config = false;
+
+        // Where the values passed to a sink come from. The first value a layer
+        // gives a repeated, map or counting target replaces the ones the layers
+        // below it gave, where a plain option simply keeps the last one.
+        enum : std::uint8_t {argv_layer, config_layer, env_layer};
+
+        ArgDefinitions &edit();
+        std::shared_ptr<const HelpText> layout() const;
+        // The flags and options (as --name) and commands closest to _name
+        std::vector<std::string> suggest(std::string_view _name) const;
+        // Clears _r for a command line of about _args arguments
+        template<class R>
+        void reset(R &_r, const std::size_t _args) const;
+        template<class S>
+        void split(ArgOptionValues<S> &_o) const;
+        // Parses into _r through a K sink, then into _r.subcommand if the
+        // command line enters a command with its own scope
+        template<class K, class R>
+        void parseScope(Source &_src, R &_r, const std::size_t _args) const;
+        const ArgParser &scope(const std::size_t _handle) const;
+        void acceptValue(const std::size_t _handle, std::string_view _name, std::string_view _value, ArgVisitor &_r) const;
+        void readEnvironment(ArgVisitor &_r) const;
+        bool validateOption(std::string_view _sa, std::size_t _equals, Source &_src, ArgVisitor &_r) const;
+        void takeValue(const std::size_t _option, std::string_view _name, std::string_view _val, const bool _has_val, Source &_src, ArgVisitor &_r) const;
+        bool validatePrefix(std::string_view _sa, std::size_t _equals, Source &_src, ArgVisitor &_r) const;
+        bool validateAttached(std::string_view _sa, ArgVisitor &_r) const;
+        bool validateFlag(std::string_view _sa, ArgVisitor &_r) const;
+        // Passes on the values of the loaded config file
+        void replayConfig(Source &_src, ArgVisitor &_r) const;
+        // Returns the handle of the command it found, npos if none. It stops at
+        // a command with its own scope, the rest of _src is for its parser.
+        std::size_t parseArgs(Source &_src, ArgVisitor &_r) const;
+        // The config file, the environment, then parseArgs, all to _v
+        std::size_t visitScope(Source &_src, ArgVisitor &_v) const;
+        // The parser of the command _handle, nullptr if it has no scope of its own
+        const ArgParser *enter(const std::size_t _handle) const;
+        // The handler dispatch runs for _r and the results it is given
+        static const ArgResults &route(const ArgResults &_r, const std::function<int(const ArgResults &)> *&_handler);
+        void splitDesc(std::string &_help, std::string_view _desc) const;
+        const ArgNames &allowedValues(const ArgOption &_option) const;
+        // Writes the allowed values of _option starting with _value, each after
+        // _before; of a list only the element after the last delimiter counts
+        void completeValue(const std::size_t _option, std::string_view _before, std::string_view _value, std::ostream &_out) const;
+        // Writes the candidates for the last argument in _src, the one being typed
+        void completeLast(Source &_src, std::ostream &_out) const;
+        std::shared_ptr<const ConfigFile> readConfig(const std::string &_path, const std::string &_section) const;
 
     public:
         int max_line_length = 80;
+        // Expand @file arguments into the arguments stored in file
+        bool response_files = false;
+        // Accept a prefix of a long name that starts no other long name, like
+        // getopt_long does, e.g. --verb for --verbose
+        bool prefix_matching = false;
 
-        ArgParser(const std::string &_name = "", const std::string &_description = "");
-        ~ArgParser();
+        // Definitions are allocated from _resource, which has to outlive the
+        // parser and every result it returns
+        ArgParser(const std::string &_name = "", const std::string &_description = "", std::pmr::memory_resource *_resource = std::pmr::get_default_resource());
 
-        void addFlag(const std::string &_name, const std::string &_help = "", const char &_abbr = '\0');
-        void addOption(const std::string &_name, const std::string &_help = "", const char &_abbr = '\0', const std::string &_defaults_to = "", const std::vector<std::string> &_allowed = {});
-        void addCommand(const std::string &_name, const std::string &_help = "");
-        std::string help();
-        ArgResults parse(const std::vector<std::string> &_args);
+        std::size_t addFlag(const std::string &_name, const std::string &_help = "", const char &_abbr = '\0');
+        // A flag that counts how often it is given, e.g. -vvv; read with results.flag.count
+        std::size_t addCounter(const std::string &_name, const std::string &_help = "", const char &_abbr = '\0');
+        std::size_t addOption(const std::string &_name, const std::string &_help = "", const char &_abbr = '\0', const std::string &_defaults_to = "", const std::vector<std::string> &_allowed = {});
+        // An option whose value is converted to _kind while parsing and can be read
+        // from results.typed; malformed values throw args::invalid_value. An
+        // integer or real option takes a negative number, e.g. --offset -5.
+        std::size_t addTypedOption(const std::string &_name, const args::value_kind _kind, const std::string &_help = "", const char &_abbr = '\0', const std::string &_defaults_to = "", const std::vector<std::string> &_allowed = {});
+        // An option that keeps every value it is given, e.g. -I a -I b, in
+        // results.repeated; results.option has the last one
+        std::size_t addRepeatedOption(const std::string &_name, const std::string &_help = "", const char &_abbr = '\0', const std::vector<std::string> &_allowed = {});
+        // An option whose value is a list, e.g. --tags=a,b,c, read with
+        // results.option.list; each element has to be one of _allowed
+        std::size_t addListOption(const std::string &_name, const std::string &_help = "", const char &_abbr = '\0', const char _delimiter = ',', const std::string &_defaults_to = "", const std::vector<std::string> &_allowed = {});
+        // An option taking key=value pairs, e.g. -DNAME=1 or --set key=value,
+        // collected in results.map; _duplicates decides what a repeated key does
+        std::size_t addMapOption(const std::string &_name, const std::string &_help = "", const char &_abbr = '\0', const args::duplicate_keys _duplicates = args::duplicate_keys::last_wins);
+        std::size_t addCommand(const std::string &_name, const std::string &_help = "");
+        // A command that dispatch runs _handler for
+        std::size_t addCommand(const std::string &_name, const std::string &_help, std::function<int(const ArgResults &)> _handler);
+        // A command with flags, options and commands of its own, e.g. the add
+        // of "tool remote add". _factory adds them to the parser it is given,
+        // the first time a command line enters the command.
+        std::size_t addCommand(const std::string &_name, const std::string &_help, std::function<void(ArgParser &)> _factory, std::function<int(const ArgResults &)> _handler = nullptr);
+        // The parser of a command added with a factory, made now if it was not
+        // yet; unknown names throw args::invalid_argument
+        const ArgParser &subparser(const std::string &_name) const;
+        // Takes the allowed values of _option from the file at _path instead,
+        // one per whitespace separated token. The file is read once, the first
+        // time a value of the option is checked; the default is not checked.
+        void allowFromFile(const std::string &_option, const std::string &_path);
+        // Falls back on the environment variable _variable when the flag or
+        // option _name is not given; the environment is read in one pass per
+        // parse, before the arguments, so they take precedence over it and it
+        // over the default; a repeated or map option or a counter given there
+        // drops what the variable gave it. A flag is set by a true boolean value
+        // (true, yes, on, 1), and an empty variable counts as unset. parseView
+        // results point into the environment for values read from it, so they
+        // dangle once setenv or putenv changes or removes the variable.
+        void bindEnv(const std::string &_name, const std::string &_variable);
+        // Reads flags and options from an INI-style file of key = value lines,
+        // keys named like the arguments and ; or # starting a comment. Keys
+        // before the first [section] apply, and so do the ones under [_section]
+        // if it is given. The command line and the environment take precedence
+        // over the file and the file over the defaults; a repeated or map option
+        // or a counter set there drops what the file gave it. Every value is
+        // checked when the file is loaded; any problem throws args::config_error.
+        void loadConfig(const std::string &_path, const std::string &_section = "");
+        // Loads the file again if its size or modification time changed, and
+        // returns whether it did. A file that fails to load throws and leaves
+        // the previous one in place. Other threads may parse meanwhile.
+        bool reloadConfig();
+        std::string help() const;
+        // Writes the help text without copying it. The buffer version writes at
+        // most _size-1 characters and a '\0', and returns the full length.
+        void help(std::ostream &_out) const;
+        std::size_t help(char *_buffer, const std::size_t _size) const;
+        ArgFootprint footprint() const;
+        ArgFrozenParser freeze() const;
+        ArgResults parse(const std::vector<std::string> &_args) const;
+        ArgResults parse(const char *const *_argv, const std::size_t _argc) const;
+        // Views into _argv and the parser, and into the environment for values
+        // of bound variables; they are only valid while those are unchanged
+        ArgResultsView parseView(const char *const *_argv, const std::size_t _argc) const;
+        // Like parse, but overwrites _r in place. The buffers _r already owns are
+        // kept, so once it has seen a command line as large as the current one
+        // parsing allocates nothing. _r is left unspecified if parsing throws.
+        void parseInto(const std::vector<std::string> &_args, ArgResults &_r) const;
+        void parseInto(const char *const *_argv, const std::size_t _argc, ArgResults &_r) const;
+        void parseInto(const char *const *_argv, const std::size_t _argc, ArgResultsView &_r) const;
+        // Results allocated from _resource, so throwing them away is free with
+        // a monotonic resource
+        ArgPmrResults parse(const std::vector<std::string> &_args, std::pmr::memory_resource *_resource) const;
+        ArgPmrResults parse(const char *const *_argv, const std::size_t _argc, std::pmr::memory_resource *_resource) const;
+        void parseInto(const std::vector<std::string> &_args, ArgPmrResults &_r) const;
+        void parseInto(const char *const *_argv, const std::size_t _argc, ArgPmrResults &_r) const;
+        // Streams the arguments to _v instead of collecting them, so memory use
+        // does not grow with the number of arguments. Values are validated
+        // before they are passed on; whatever was visited before an exception
+        // has already been seen by _v.
+        void visit(const std::vector<std::string> &_args, ArgVisitor &_v) const;
+        void visit(const char *const *_argv, const std::size_t _argc, ArgVisitor &_v) const;
+        // Runs the handler of the command in _r, or of the innermost command
+        // with one if it entered subcommands, with the results that hold that
+        // command. The command was found while parsing, so nothing is looked up
+        // again. Throws args::no_handler if there is nothing to run.
+        int dispatch(const ArgResults &_r) const;
+        // Reads command lines from _in until it ends, splits them into arguments
+        // like a response file and dispatches them. Errors, including the
+        // std::exceptions a handler throws, are written to _out and do not stop
+        // the loop; _prompt is written before every line. Returns the status of
+        // the last handler that returned.
+        int repl(std::istream &_in, std::ostream &_out, const std::string &_prompt = "") const;
+        // A script for _shell that completes the command line of _program (the
+        // parser's name if empty) by running "_program __complete <arguments>"
+        std::string completion(const args::shell _shell, const std::string &_program = "") const;
+        void completion(std::ostream &_out, const args::shell _shell, const std::string &_program = "") const;
+        // Answers the query of a completion script if the first argument is
+        // __complete and returns true, so the program can exit right away;
+        // returns false for any other command line. The arguments after
+        // __complete are what has been typed, the last one the word under the
+        // cursor. Its candidates are written to _out one per line, followed by
+        // a tab and the help text if they have one. The arguments before it are
+        // only looked up, not checked, and no results are made.
+        bool complete(const std::vector<std::string> &_args, std::ostream &_out) const;
+        bool complete(const char *const *_argv, const std::size_t _argc, std::ostream &_out) const;
 
         template<class T, class = typename std::enable_if<std::is_same<T, char>::value>::type, std::size_t S, std::size_t S2>
-        ArgResults parse(const T (&_args)[S][S2]) {
-            std::vector<std::string> v;
+        ArgResults parse(const T (&_args)[S][S2]) const {
+            const char *v[S];
             for(std::size_t i = 0; i < S; ++i) {
-                std::string s = _args[i];
-                v.push_back(s);
+                v[i] = _args[i];
             }
 
-            return parse(v);
+            return parse(v, S);
         }
 
         template<class T, class = typename std::enable_if<std::is_same<T, char*>::value>::type, std::size_t S>
-        ArgResults parse(const T (&_args)[S]) {
-            std::vector<std::string> v;
-            for(std::size_t i = 0; i < S; ++i) {
-                std::string s = _args[i];
-                v.push_back(s);
-            }
-
-            return parse(v);
+        ArgResults parse(const T (&_args)[S]) const {
+            return parse(static_cast<const char *const *>(_args), S);
         }
 
         template<class T, class = typename std::enable_if<std::is_same<T, char**>::value>::type>
-        ArgResults parse(const T (&_args), const std::size_t S) {
-            std::vector<std::string> v;
-            for(std::size_t i = 0; i < S; ++i) {
-                std::string s = _args[i];
-                v.push_back(s);
-            }
+        ArgResults parse(const T (&_args), const std::size_t S) const {
+            return parse(static_cast<const char *const *>(_args), S);
+        }
+
+};
+
+// Read-only snapshot of an ArgParser. No definition can be added or changed
+// after freeze(), so any number of threads can parse with the same instance at
+// the same time. What is still filled in on first use is safe to share: the
+// scopes of commands are built under a mutex, allowed values files are loaded
+// under a lock, and the help and name index caches are swapped in whole with
+// std::atomic_store. help() gives the text rendered by freeze().
+class ArgFrozenParser {
+    private:
+        const ArgParser parser;
+        const std::string help_text;
+
+        friend class ArgParser;
+
+        ArgFrozenParser(const ArgParser &_parser);
 
-            return parse(v);
+        static void schedule(const std::size_t _size, unsigned _threads, const std::function<void(std::size_t)> &_job);
+
+    public:
+        const std::string &help() const;
+        void help(std::ostream &_out) const;
+        std::size_t help(char *_buffer, const std::size_t _size) const;
+        ArgResults parse(const std::vector<std::string> &_args) const;
+        ArgResultsView parseView(const char *const *_argv, const std::size_t _argc) const;
+        void parseInto(const std::vector<std::string> &_args, ArgResults &_r) const;
+        void parseInto(const char *const *_argv, const std::size_t _argc, ArgResults &_r) const;
+        void parseInto(const char *const *_argv, const std::size_t _argc, ArgResultsView &_r) const;
+        ArgPmrResults parse(const std::vector<std::string> &_args, std::pmr::memory_resource *_resource) const;
+        ArgPmrResults parse(const char *const *_argv, const std::size_t _argc, std::pmr::memory_resource *_resource) const;
+        void parseInto(const std::vector<std::string> &_args, ArgPmrResults &_r) const;
+        void parseInto(const char *const *_argv, const std::size_t _argc, ArgPmrResults &_r) const;
+        void visit(const std::vector<std::string> &_args, ArgVisitor &_v) const;
+        void visit(const char *const *_argv, const std::size_t _argc, ArgVisitor &_v) const;
+        int dispatch(const ArgResults &_r) const;
+        int repl(std::istream &_in, std::ostream &_out, const std::string &_prompt = "") const;
+        bool complete(const std::vector<std::string> &_args, std::ostream &_out) const;
+        bool complete(const char *const *_argv, const std::size_t _argc, std::ostream &_out) const;
+        std::vector<ArgBatchResult> parseBatch(const std::vector<std::vector<std::string>> &_batch, const unsigned _threads = 0) const;
+
+        // Parses every entry of _batch on _threads threads (all cores if 0). The
+        // results are in the same order as the input and an entry that fails to
+        // parse gets its exception in error instead of stopping the batch.
+        template<class T>
+        std::vector<ArgBatchResult> parseBatch(const T *_batch, const std::size_t _size, const unsigned _threads = 0) const {
+            std::vector<ArgBatchResult> batch(_size);
+            schedule(_size, _threads, [&](std::size_t _i) {
+                try {
+                    batch[_i].results = parse(_batch[_i]);
+                }catch(...) {
+                    batch[_i].error = std::current_exception();
+                }
+            });
+
+            return batch;
         }
 
+        template<class T>
+        ArgResults parse(const T &_args) const {
+            return parser.parse(_args);
+        }
+
+        template<class T>
+        ArgResults parse(const T &_args, const std::size_t _argc) const {
+            return parser.parse(_args, _argc);
+        }
 };
+
+namespace args {
+    enum class spec_kind {
+        flag,
+        option,
+        command
+    };
+
+    // One argument of a compile-time schema
+    struct spec {
+        spec_kind kind;
+        std::string_view name;
+        char abbr;
+        std::string_view defaults_to;
+    };
+
+    constexpr spec flag(std::string_view _name, const char _abbr = '\0') {
+        return {spec_kind::flag, _name, _abbr, std::string_view()};
+    }
+
+    constexpr spec option(std::string_view _name, const char _abbr = '\0', std::string_view _defaults_to = std::string_view()) {
+        return {spec_kind::option, _name, _abbr, _defaults_to};
+    }
+
+    constexpr spec command(std::string_view _name) {
+        return {spec_kind::command, _name, '\0', std::string_view()};
+    }
+
+    constexpr std::uint64_t hash(std::string_view _s, const std::uint64_t _seed) {
+        std::uint64_t h = 0xcbf29ce484222325ull ^ (_seed*0x9e3779b97f4a7c15ull);
+        for(char c : _s) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 0x100000001b3ull;
+        }
+        return h ^ (h >> 32);
+    }
+
+    constexpr std::size_t pow2(const std::size_t _n) {
+        std::size_t p = 1;
+        while(p < _n) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    template<std::size_t N>
+    class static_results;
+
+    // Parser whose arguments are fixed at compile time. The compiler builds a
+    // perfect hash (hash and displace) for the long names and a direct table for
+    // the abbreviations, so there is nothing to register or allocate at startup.
+    // Handles are the positions of the specs in the list given to the constructor.
+    template<std::size_t N>
+    class schema {
+        static_assert(N > 0 && N < 0xffff, "a schema needs between 1 and 65534 arguments");
+
+        public:
+            static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+            static constexpr std::size_t slots = pow2(2*N);
+            static constexpr std::size_t buckets = pow2(N/2 > 0 ? N/2 : 1);
+
+        private:
+            spec specs[N] = {};
+            std::uint32_t displacement[buckets] = {};
+            std::uint16_t table[slots] = {};
+            std::uint16_t flag_abbr[256] = {};
+            std::uint16_t option_abbr[256] = {};
+
+            // commands live in their own namespace, so they are hashed with a different seed
+            static constexpr std::uint64_t group(const spec_kind _kind) {
+                return _kind == spec_kind::command ? 1 : 0;
+            }
+
+            static constexpr std::size_t slot(std::string_view _name, const std::uint64_t _group, const std::uint32_t _d) {
+                return hash(_name, (std::uint64_t(_d) << 1) | _group) & (slots-1);
+            }
+
+            bool validateOption(std::string_view _sa, const std::size_t _equals, const char *const *_argv, const std::size_t _argc, std::size_t &_i, static_results<N> &_r) const {
+                std::string_view val;
+                bool has_val = false;
+                if(_sa.length() >= 2 && _equals != std::string_view::npos) {
+                    if(_equals != _sa.size()-1) {
+                        val = _sa.substr(_equals+1);
+                        _sa = _sa.substr(0, _equals);
+                        has_val = true;
+                    }else {
+                        throw args::missing_value(std::string(_sa.substr(0, _equals)));
+                    }
+                }
+
+                std::size_t found = find(_sa);
+                if(found == npos || specs[found].kind != spec_kind::option) {
+                    found = _sa.length() == 1 ? find(_sa[0], spec_kind::option) : npos;
+                }
+                if(found == npos) {
+                    return false;
+                }
+
+                if(!has_val && _i < _argc) {
+                    val = _argv[_i] != nullptr ? std::string_view(_argv[_i]) : std::string_view();
+                    ++_i;
+                }
+                if(val.empty() || val[0] == '-') {
+                    throw args::missing_value(std::string(_sa));
+                }
+                _r.values[found] = val;
+
+                return true;
+            }
+
+            bool validateFlag(std::string_view _sa, static_results<N> &_r) const {
+                std::size_t found = find(_sa);
+                if(found == npos || specs[found].kind != spec_kind::flag) {
+                    found = _sa.length() == 1 ? find(_sa[0], spec_kind::flag) : npos;
+                }
+                if(found == npos) {
+                    return false;
+                }
+                _r.bits[found/64] |= std::uint64_t(1) << (found%64);
+
+                return true;
+            }
+
+        public:
+            constexpr schema(const spec (&_specs)[N]) {
+                std::size_t bucket_of[N] = {};
+                std::size_t start[buckets+1] = {};
+                for(std::size_t i = 0; i < N; ++i) {
+                    specs[i] = _specs[i];
+                    bucket_of[i] = hash(specs[i].name, group(specs[i].kind)) & (buckets-1);
+                    ++start[bucket_of[i]+1];
+                    if(specs[i].abbr != '\0') {
+                        std::uint16_t *abbr = specs[i].kind == spec_kind::flag ? flag_abbr : option_abbr;
+                        unsigned char c = static_cast<unsigned char>(specs[i].abbr);
+                        if(abbr[c] == 0) {
+                            abbr[c] = static_cast<std::uint16_t>(i+1);
+                        }
+                    }
+                }
+
+                // group the specs by bucket
+                std::size_t largest = 0;
+                for(std::size_t b = 0; b < buckets; ++b) {
+                    if(start[b+1] > largest) {
+                        largest = start[b+1];
+                    }
+                    start[b+1] += start[b];
+                }
+                std::size_t members[N] = {};
+                std::size_t fill[buckets] = {};
+                for(std::size_t i = 0; i < N; ++i) {
+                    std::size_t b = bucket_of[i];
+                    members[start[b]+fill[b]] = i;
+                    ++fill[b];
+                }
+
+                // equal names always share a bucket
+                for(std::size_t b = 0; b < buckets; ++b) {
+                    for(std::size_t i = start[b]; i < start[b+1]; ++i) {
+                        for(std::size_t j = i+1; j < start[b+1]; ++j) {
+                            const spec &x = specs[members[i]];
+                            const spec &y = specs[members[j]];
+                            if(x.name == y.name && group(x.kind) == group(y.kind)) {
+                                throw args::duplicate_argument(std::string(y.name));
+                            }
+                        }
+                    }
+                }
+
+                // place the biggest buckets first, each one with the first
+                // displacement that sends all of its names to free slots
+                for(std::size_t size = largest; size > 0; --size) {
+                    for(std::size_t b = 0; b < buckets; ++b) {
+                        if(start[b+1]-start[b] != size) {
+                            continue;
+                        }
+                        for(std::uint32_t d = 1; ; ++d) {
+                            bool free = true;
+                            for(std::size_t i = start[b]; i < start[b+1] && free; ++i) {
+                                const spec &x = specs[members[i]];
+                                std::size_t s = slot(x.name, group(x.kind), d);
+                                if(table[s] != 0) {
+                                    free = false;
+                                }
+                                for(std::size_t j = start[b]; j < i && free; ++j) {
+                                    const spec &y = specs[members[j]];
+                                    if(slot(y.name, group(y.kind), d) == s) {
+                                        free = false;
+                                    }
+                                }
+                            }
+                            if(free) {
+                                displacement[b] = d;
+                                for(std::size_t i = start[b]; i < start[b+1]; ++i) {
+                                    const spec &x = specs[members[i]];
+                                    table[slot(x.name, group(x.kind), d)] = static_cast<std::uint16_t>(members[i]+1);
+                                }
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+
+            constexpr std::size_t size() const {
+                return N;
+            }
+
+            constexpr const spec &operator[](const std::size_t _handle) const {
+                return specs[_handle];
+            }
+
+            // Handle of a flag or option, or of a command if _command is set
+            constexpr std::size_t find(std::string_view _name, const bool _command = false) const {
+                std::uint64_t g = _command ? 1 : 0;
+                std::size_t b = hash(_name, g) & (buckets-1);
+                std::size_t i = table[slot(_name, g, displacement[b])];
+                if(i != 0 && specs[i-1].name == _name && group(specs[i-1].kind) == g) {
+                    return i-1;
+                }
+                return npos;
+            }
+
+            constexpr std::size_t find(const char _abbr, const spec_kind _kind) const {
+                const std::uint16_t *abbr = _kind == spec_kind::flag ? flag_abbr : option_abbr;
+                std::size_t i = abbr[static_cast<unsigned char>(_abbr)];
+                return i != 0 ? i-1 : npos;
+            }
+
+            static_results<N> parse(const char *const *_argv, const std::size_t _argc) const {
+                static_results<N> results(*this);
+
+                std::size_t i = 0;
+                // as with ArgParser, a command has to be the first word, options may come before it
+                bool command = true;
+                while(i < _argc) {
+                    std::string_view arg = _argv[i] != nullptr ? std::string_view(_argv[i]) : std::string_view();
+                    ++i;
+
+                    args::token t = args::classify(arg);
+                    if(t.kind == args::token_kind::short_cluster) {
+                        std::string_view stripped_arg = arg.substr(1);
+                        if(!validateOption(stripped_arg, t.equals == std::string_view::npos ? t.equals : t.equals-1, _argv, _argc, i, results)) {
+                            if(arg.length() > 2) {
+                                // multiple flags
+                                for(std::size_t j = 0; j < stripped_arg.length(); ++j) {
+                                    if(!validateFlag(stripped_arg.substr(j, 1), results)) {
+                                        throw args::invalid_argument(std::string(1, stripped_arg[j]));
+                                    }
+                                }
+                            }else if(!validateFlag(stripped_arg, results)) {
+                                throw args::invalid_argument(std::string(stripped_arg));
+                            }
+                        }
+                    }else if(t.kind == args::token_kind::long_option || t.kind == args::token_kind::long_value) {
+                        std::string_view stripped_arg = arg.substr(2);
+                        if(!validateOption(stripped_arg, t.equals == std::string_view::npos ? t.equals : t.equals-2, _argv, _argc, i, results)) {
+                            if(!validateFlag(stripped_arg, results)) {
+                                throw args::invalid_argument(std::string(stripped_arg));
+                            }
+                        }
+                    }else if(t.kind == args::token_kind::word) {
+                        if(command && find(arg, true) != npos) {
+                            results.command = arg;
+                        }else {
+                            results.positional.push_back(arg);
+                        }
+                        command = false;
+                    }
+                }
+
+                return results;
+            }
+    };
+
+    template<std::size_t N>
+    class static_results {
+        private:
+            const schema<N> *s;
+            std::uint64_t bits[(N+63)/64] = {};
+            std::string_view values[N];
+
+            friend class schema<N>;
+
+        public:
+            std::vector<std::string_view> positional;
+            std::string_view command;
+
+            static_results(const schema<N> &_s) : s(&_s) {
+                for(std::size_t i = 0; i < N; ++i) {
+                    values[i] = _s[i].defaults_to;
+                }
+            }
+
+            bool flag(const std::size_t _handle) const {
+                return _handle < N && (bits[_handle/64] >> (_handle%64)) & 1;
+            }
+
+            bool flag(std::string_view _name) const {
+                return flag(s->find(_name));
+            }
+
+            std::string_view option(const std::size_t _handle) const {
+                return _handle < N ? values[_handle] : std::string_view();
+            }
+
+            std::string_view option(std::string_view _name) const {
+                return option(s->find(_name));
+            }
+    };
+}
@@ -1,8 +1,43 @@
 #include "../headers/args.h"
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <charconv>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <sstream>
+#include <cctype>
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <stdlib.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #ifdef __APPLE__
+        #include <crt_externs.h>
+    #else
+        extern char **environ;
+    #endif
+#endif
 
 // Exceptions
-args::invalid_argument::invalid_argument(const std::string &_arg) : arg(_arg) {
+args::invalid_argument::invalid_argument(const std::string &_arg, const std::vector<std::string> &_suggestions) : arg(_arg), similar(_suggestions) {
     error = "argument \""+arg+"\" does not exist";
+    for(std::size_t i = 0; i < similar.size(); ++i) {
+        error += (i == 0 ? ", did you mean " : " or ")+similar[i];
+    }
+    if(!similar.empty()) {
+        error += '?';
+    }
 }
 
 const char* args::invalid_argument::what() const throw() {
@@ -13,6 +48,10 @@ const char* args::invalid_argument::which() {
     return arg.c_str();
 }
 
+const std::vector<std::string>& args::invalid_argument::suggestions() {
+    return similar;
+}
+
 args::invalid_value::invalid_value(const std::string &_arg, const std::string &_value) : arg(_arg), value(_value) {
     error = "no value named \""+value+"\" for argument \""+arg+"\"";
 }
@@ -53,391 +92,2584 @@ const char* args::duplicate_argument::which() {
     return arg.c_str();
 }
 
-// Flag
-ArgFlag::ArgFlag(const std::string &_help) : help(_help) {}
+args::response_file_error::response_file_error(const std::string &_file, const std::string &_reason) : file(_file) {
+    error = "cannot read response file \""+file+"\": "+_reason;
+}
 
-// Option
-ArgOption::ArgOption(
-    const std::string &_help,
-    const std::string &_defaults_to,
-    const std::vector<std::string> &_allowed
-) : help(_help), defaults_to(_defaults_to), allowed(_allowed) {}
+const char* args::response_file_error::what() const throw() {
+    return error.c_str();
+}
 
-// Results
-ArgResults::ArgResults() {}
+const char* args::response_file_error::which() {
+    return file.c_str();
+}
 
-// Parser
-ArgParser::ArgParser(const std::string &_name, const std::string &_description) : name(_name), description(_description) {}
+args::config_error::config_error(const std::string &_file, const std::string &_reason) : file(_file) {
+    error = "cannot load config file \""+file+"\": "+_reason;
+}
 
-ArgParser::~ArgParser() {
-    for(auto i = flags.begin(); i != flags.end(); ++i) {
-        delete i->second;
-    }
-    for(auto i = options.begin(); i != options.end(); ++i) {
-        delete i->second;
+const char* args::config_error::what() const throw() {
+    return error.c_str();
+}
+
+const char* args::config_error::which() {
+    return file.c_str();
+}
+
+args::no_handler::no_handler(const std::string &_command) : command(_command) {
+    error = command.empty() ? "no command given" : "command \""+command+"\" has no handler";
+}
+
+const char* args::no_handler::what() const throw() {
+    return error.c_str();
+}
+
+const char* args::no_handler::which() {
+    return command.c_str();
+}
+
+args::ambiguous_argument::ambiguous_argument(const std::string &_arg, const std::vector<std::string> &_matches) : arg(_arg), matches(_matches) {
+    error = "argument \""+arg+"\" is ambiguous, it could be";
+    for(std::size_t i = 0; i < matches.size(); ++i) {
+        error += (i == 0 ? " " : ", ")+matches[i];
     }
 }
 
-bool ArgParser::validateOption(const std::vector<std::string> &_a, std::string _sa, std::size_t &_i, ArgResults &_r) {
-    std::string val;
-    std::size_t equals = _sa.find("=");
-    if(_sa.length() < 2) {
-        if(_i+1 < _a.size()) {
-            val = _a[_i+1];
-        }else {
-            val = "";
-        }
+const char* args::ambiguous_argument::what() const throw() {
+    return error.c_str();
+}
+
+const char* args::ambiguous_argument::which() {
+    return arg.c_str();
+}
+
+const std::vector<std::string>& args::ambiguous_argument::candidates() {
+    return matches;
+}
+
+// Tokens
+args::token args::classify(std::string_view _arg) {
+    token t = {token_kind::word, std::string_view::npos};
+    if(_arg.empty()) {
+        t.kind = token_kind::empty;
+        return t;
+    }
+    if(_arg[0] != '-' || _arg.length() < 2) {
+        return t;
+    }
+
+    std::size_t first;
+    if(_arg[1] != '-') {
+        t.kind = token_kind::short_cluster;
+        first = 1;
+    }else if(_arg.length() > 2 && _arg[2] != '-') {
+        t.kind = token_kind::long_option;
+        first = 2;
     }else {
-        if(equals != std::string::npos) {
-            if(equals != _sa.size()-1) {
-                val = _sa.substr(equals+1);
-                _sa = _sa.substr(0, equals);
-                --_i;
-            }else {
-                throw args::missing_value(_sa.substr(0, equals));
+        return t;
+    }
+
+    // the first character after the dashes may be anything but '-', the rest
+    // may not contain line breaks (same rules the old regexes had)
+    for(std::size_t i = first; i < _arg.length(); ++i) {
+        char c = _arg[i];
+        if(c == '=') {
+            if(t.equals == std::string_view::npos) {
+                t.equals = i;
             }
-        }else {
-            if(options_abbr.find(_sa.substr(0, 1)) != options_abbr.end()) {
-                if(_i+1 < _a.size()) {
-                    val = _a[_i+1];
-                }
-                //--_i;
-            }else {
-                if(_i+1 < _a.size()) {
-                    val = _a[_i+1];
-                }else {
-                    val = "";
+        }else if((c == '\n' || c == '\r') && i > first) {
+            t.kind = token_kind::word;
+            t.equals = std::string_view::npos;
+            return t;
+        }
+    }
+    if(t.kind == token_kind::long_option && t.equals != std::string_view::npos) {
+        t.kind = token_kind::long_value;
+    }
+
+    return t;
+}
+
+// Values
+namespace {
+    char **environment() {
+#if defined(_WIN32)
+        return _environ;
+#elif defined(__APPLE__)
+        return *_NSGetEnviron();
+#else
+        return environ;
+#endif
+    }
+
+    // Whole string as an unsigned number, rest is what follows the digits
+    bool leadingNumber(std::string_view _value, std::uint64_t &_n, std::string_view &_rest) {
+        const char *end = _value.data()+_value.size();
+        auto r = std::from_chars(_value.data(), end, _n);
+        if(r.ec != std::errc() || r.ptr == _value.data()) {
+            return false;
+        }
+        _rest = std::string_view(r.ptr, end-r.ptr);
+        return true;
+    }
+
+    bool scaled(const std::uint64_t _n, const std::uint64_t _unit, std::uint64_t &_out) {
+        if(_n > std::uint64_t(std::numeric_limits<std::int64_t>::max())/_unit) {
+            return false;
+        }
+        _out = _n*_unit;
+        return true;
+    }
+
+    bool convertSize(std::string_view _value, std::uint64_t &_bytes) {
+        std::uint64_t n;
+        std::string_view suffix;
+        if(!leadingNumber(_value, n, suffix)) {
+            return false;
+        }
+        std::uint64_t unit = 1;
+        if(!suffix.empty()) {
+            const char *units = "KMGT";
+            const char *u = static_cast<const char*>(std::memchr(units, suffix[0] & ~0x20, 4));
+            if(u != nullptr) {
+                unit <<= 10*(u-units+1);
+                suffix.remove_prefix(1);
+                if(suffix == "iB") {
+                    suffix.remove_prefix(2);
                 }
             }
+            if(suffix == "B") {
+                suffix.remove_prefix(1);
+            }
         }
+        return suffix.empty() && scaled(n, unit, _bytes);
     }
 
-    auto found_option = options.find(_sa);
-    bool found = false;
-    if(found_option == options.end()) {
-        auto found_abbr = options_abbr.find(_sa);
-        if(found_abbr != options_abbr.end()) {
-            found_option = options.find(found_abbr->second);
-            found = true;
+    // Calls _element with every piece of _value between delimiters, empty ones
+    // included. With SSE2 the delimiters are found 16 bytes at a time; a list
+    // of short ids has one every few bytes, too many to call memchr for each.
+    template<class F>
+    void forEachElement(std::string_view _value, const char _delimiter, F &&_element) {
+        const char *p = _value.data();
+        const char *end = p+_value.size();
+        const char *start = p;
+#ifdef __SSE2__
+        const __m128i delimiter = _mm_set1_epi8(_delimiter);
+        for(; end-p >= 16; p += 16) {
+            unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), delimiter));
+            while(mask != 0) {
+                const char *found = p+__builtin_ctz(mask);
+                _element(std::string_view(start, found-start));
+                start = found+1;
+                mask &= mask-1;
+            }
         }
-    }else {
-        found = true;
+#endif
+        const char *found;
+        while(p != end && (found = static_cast<const char*>(std::memchr(p, _delimiter, end-p))) != nullptr) {
+            _element(std::string_view(start, found-start));
+            start = p = found+1;
+        }
+        _element(std::string_view(start, end-start));
     }
 
-    if(found) {
-        if(val.empty() || val[0] == '-') {
-            throw args::missing_value(_sa);
-        }else {
-            ArgOption *valid_option = found_option->second;
-            if(!valid_option->allowed.empty()) {
-                bool valid_value = false;
-                for(auto o : valid_option->allowed) {
-                    if(o == val) {
-                        valid_value = true;
-                        break;
-                    }
-                }
-                if(valid_value) {
-                    _r.option[found_option->first] = val;
-                }else {
-                    throw args::invalid_value(_sa, val);
+    bool convertDuration(std::string_view _value, std::uint64_t &_ns) {
+        static const struct {
+            std::string_view name;
+            std::uint64_t ns;
+        } units[] = {
+            {"ns", 1}, {"us", 1000}, {"ms", 1000000}, {"s", 1000000000},
+            {"m", 60000000000ull}, {"h", 3600000000000ull}, {"d", 86400000000000ull}
+        };
+
+        _ns = 0;
+        std::uint64_t n;
+        std::string_view rest;
+        if(!leadingNumber(_value, n, rest)) {
+            return false;
+        }
+        if(rest.empty()) {
+            return scaled(n, 1000000000, _ns);
+        }
+        while(true) {
+            std::size_t length = 0;
+            while(length < rest.size() && (rest[length] < '0' || rest[length] > '9')) {
+                ++length;
+            }
+            std::uint64_t unit = 0;
+            for(const auto &u : units) {
+                if(rest.substr(0, length) == u.name) {
+                    unit = u.ns;
                 }
-            }else {
-                _r.option[found_option->first] = val;
+            }
+            std::uint64_t part;
+            if(unit == 0 || !scaled(n, unit, part) || part > std::uint64_t(std::numeric_limits<std::int64_t>::max())-_ns) {
+                return false;
+            }
+            _ns += part;
+            rest.remove_prefix(length);
+            if(rest.empty()) {
+                return true;
+            }
+            if(!leadingNumber(rest, n, rest)) {
+                return false;
             }
         }
-
-        return true;
-    }else {
-        return false;
     }
 }
 
-bool ArgParser::validateFlag(const std::string &_sa, ArgResults &_r) {
-    auto found_flag = flags.find(_sa);
-    bool found = false;
-    if(found_flag == flags.end()) {
-        auto found_abbr = flags_abbr.find(_sa);
-        if(found_abbr != flags_abbr.end()) {
-            found_flag = flags.find(found_abbr->second);
-            found = true;
+bool args::convert(const value_kind _kind, std::string_view _value, typed_value &_out) {
+    const char *end = _value.data()+_value.size();
+    switch(_kind) {
+        case value_kind::integer: {
+            auto r = std::from_chars(_value.data(), end, _out.integer);
+            _out.real = double(_out.integer);
+            return r.ec == std::errc() && r.ptr == end;
         }
-    }else {
-        found = true;
+        case value_kind::real: {
+            auto r = std::from_chars(_value.data(), end, _out.real);
+            // from_chars reads inf and nan as well
+            if(r.ec != std::errc() || r.ptr != end || !std::isfinite(_out.real)) {
+                return false;
+            }
+            // casting a double out of the range of int64_t is undefined, so the
+            // integer is clamped; limit is 2^63
+            const double limit = 9223372036854775808.0;
+            if(_out.real >= limit) {
+                _out.integer = std::numeric_limits<std::int64_t>::max();
+            }else if(_out.real < -limit) {
+                _out.integer = std::numeric_limits<std::int64_t>::min();
+            }else {
+                _out.integer = static_cast<std::int64_t>(_out.real);
+            }
+            return true;
+        }
+        case value_kind::boolean:
+            if(_value == "true" || _value == "yes" || _value == "on" || _value == "1") {
+                _out = {1, 1.0};
+            }else if(_value == "false" || _value == "no" || _value == "off" || _value == "0") {
+                _out = {0, 0.0};
+            }else {
+                return false;
+            }
+            return true;
+        case value_kind::duration: {
+            std::uint64_t ns;
+            if(!convertDuration(_value, ns)) {
+                return false;
+            }
+            _out = {std::int64_t(ns), double(ns)/1e9};
+            return true;
+        }
+        case value_kind::size: {
+            std::uint64_t bytes;
+            if(!convertSize(_value, bytes)) {
+                return false;
+            }
+            _out = {std::int64_t(bytes), double(bytes)};
+            return true;
+        }
+        default:
+            // strings need no conversion, choices are looked up in allowed
+            return false;
     }
+}
 
-    if(found) {
-        _r.flag[found_flag->first] = true;
-        return true;
-    }else {
-        return false;
+// Flag
+ArgFlag::ArgFlag(std::string_view _help, const allocator_type &_alloc) : help(_help, _alloc) {}
+
+ArgFlag::ArgFlag(const ArgFlag &_other, const allocator_type &_alloc) : help(_other.help, _alloc), abbr(_other.abbr), counter(_other.counter), env(_other.env) {}
+
+ArgFlag::ArgFlag(ArgFlag &&_other, const allocator_type &_alloc) : help(std::move(_other.help), _alloc), abbr(_other.abbr), counter(_other.counter), env(_other.env) {}
+
+// Option
+ArgOption::ArgOption(
+    std::string_view _help,
+    std::string_view _defaults_to,
+    const std::vector<std::string> &_allowed,
+    const allocator_type &_alloc
+) : help(_help, _alloc), defaults_to(_defaults_to, _alloc), allowed(_alloc) {
+    for(const auto &a : _allowed) {
+        allowed.add(a);
     }
 }
 
-std::string ArgParser::findFlagAbbr(const std::string &_name) {
-    for(auto i = flags_abbr.begin(); i != flags_abbr.end(); ++i) {
-        if(i->second == _name) {
-            return std::string(i->first);
-        }
+ArgOption::ArgOption(const ArgOption &_other, const allocator_type &_alloc) : help(_other.help, _alloc), defaults_to(_other.defaults_to, _alloc), allowed(_other.allowed, _alloc), allowed_file(_other.allowed_file), abbr(_other.abbr), repeated(_other.repeated), delimiter(_other.delimiter), map(_other.map), duplicates(_other.duplicates), env(_other.env), kind(_other.kind), typed_default(_other.typed_default) {}
+
+ArgOption::ArgOption(ArgOption &&_other, const allocator_type &_alloc) : help(std::move(_other.help), _alloc), defaults_to(std::move(_other.defaults_to), _alloc), allowed(std::move(_other.allowed), _alloc), allowed_file(std::move(_other.allowed_file)), abbr(_other.abbr), repeated(_other.repeated), delimiter(_other.delimiter), map(_other.map), duplicates(_other.duplicates), env(_other.env), kind(_other.kind), typed_default(_other.typed_default) {}
+
+// Results
+ArgResults::ArgResults() {}
+
+std::size_t ArgResults::footprint() const {
+    std::size_t bytes = flag.bits.capacity()*sizeof(std::uint64_t)+typed.values.capacity()*sizeof(args::typed_value)+ArgFootprint::of(command);
+    bytes += (option.values.capacity()+positional.capacity()+spare.capacity())*sizeof(std::string);
+    bytes += option.slices.capacity()*sizeof(ArgSlice)+option.starts.capacity()*sizeof(std::uint32_t);
+    for(const auto &v : option.values) {
+        bytes += ArgFootprint::of(v);
+    }
+    for(const auto &p : positional) {
+        bytes += ArgFootprint::of(p);
+    }
+    for(const auto &p : spare) {
+        bytes += ArgFootprint::of(p);
+    }
+    if(subcommand != nullptr) {
+        bytes += sizeof(ArgResults)+subcommand->footprint();
+    }
+    bytes += (flag.counts.capacity()+repeated.handles.capacity()+repeated.starts.capacity())*sizeof(std::uint32_t);
+    bytes += (repeated.values.capacity()+repeated.grouped.capacity())*sizeof(std::string);
+    for(const auto &v : repeated.values) {
+        bytes += ArgFootprint::of(v);
+    }
+    for(const auto &v : repeated.grouped) {
+        bytes += ArgFootprint::of(v);
     }
-    return "";
+    bytes += map.entries.capacity()*sizeof(std::string);
+    bytes += (map.options.capacity()+map.keys.capacity()+map.slots.capacity()+map.sizes.capacity())*sizeof(std::uint32_t);
+    for(const auto &e : map.entries) {
+        bytes += ArgFootprint::of(e);
+    }
+    bytes += flag.layers.capacity()+repeated.layers.capacity()+map.layers.capacity();
+    return bytes;
 }
 
-std::string ArgParser::findOptionAbbr(const std::string &_name) {
-    for(auto i = options_abbr.begin(); i != options_abbr.end(); ++i) {
-        if(i->second == _name) {
-            return std::string(i->first);
-        }
-    }
-    return "";
+ArgResultsView::ArgResultsView() {}
+
+ArgPmrResults::ArgPmrResults(const allocator_type &_alloc) : flag(_alloc), option(_alloc), typed(_alloc), repeated(_alloc), map(_alloc), positional(_alloc), command(_alloc) {}
+
+std::size_t ArgResultsView::footprint() const {
+    return flag.bits.capacity()*sizeof(std::uint64_t)
+        +typed.values.capacity()*sizeof(args::typed_value)
+        +(flag.counts.capacity()+option.starts.capacity()+repeated.handles.capacity()+repeated.starts.capacity())*sizeof(std::uint32_t)
+        +(map.options.capacity()+map.keys.capacity()+map.slots.capacity()+map.sizes.capacity())*sizeof(std::uint32_t)
+        +flag.layers.capacity()+repeated.layers.capacity()+map.layers.capacity()
+        +option.slices.capacity()*sizeof(ArgSlice)
+        +(option.values.capacity()+positional.capacity()+repeated.values.capacity()+repeated.grouped.capacity()+map.entries.capacity())*sizeof(std::string_view)
+        +files.capacity()*sizeof(std::shared_ptr<const void>)
+        +(subcommand != nullptr ? sizeof(ArgResultsView)+subcommand->footprint() : 0);
 }
 
-void ArgParser::splitDesc(std::string &_help, std::string &_desc) {
-    std::size_t desc_length = _desc.length();
-    std::size_t last = 0;
-    int line_length = max_line_length-8;
-    std::string indent = "        ";
-    while(desc_length > line_length) {
-        std::size_t token;
-        if(last+line_length >= last+desc_length) {
-            _help += indent + _desc.substr(last) + '\n';
-            break;
-        }else {
-            token = _desc.rfind(" ", last+line_length);
-        }
-        if(token != std::string::npos && token > last) {
-            _help += indent + _desc.substr(last, token-last) + '\n';
-            desc_length -= token-last-1;
-            last = token+1;
-        }else {
-            _help += indent + _desc.substr(last) + '\n';
-            break;
+bool ArgBatchResult::ok() const {
+    return error == nullptr;
+}
+
+ArgVisitor::~ArgVisitor() {}
+void ArgVisitor::flag(const std::size_t /*_handle*/) {}
+void ArgVisitor::option(const std::size_t /*_handle*/, std::string_view /*_value*/) {}
+void ArgVisitor::typed(const std::size_t /*_handle*/, const args::typed_value &/*_value*/) {}
+void ArgVisitor::positional(std::string_view /*_arg*/) {}
+void ArgVisitor::command(std::string_view /*_arg*/) {}
+
+// Names
+ArgNames::ArgNames(const allocator_type &_alloc) : pool(_alloc), ends(_alloc), slots(_alloc) {}
+
+ArgNames::ArgNames(const ArgNames &_other, const allocator_type &_alloc) : pool(_other.pool, _alloc), ends(_other.ends, _alloc), slots(_other.slots, _alloc) {}
+
+void ArgNames::rehash(const std::size_t _slots) {
+    slots.assign(_slots, 0);
+    const std::size_t mask = _slots-1;
+    for(std::size_t h = 0; h < ends.size(); ++h) {
+        std::size_t i = std::hash<std::string_view>()((*this)[h]) & mask;
+        while(slots[i] != 0) {
+            i = (i+1) & mask;
         }
+        slots[i] = h+1;
     }
-    _help += indent + _desc.substr(last) + '\n';
 }
 
-void ArgParser::addFlag(const std::string &_name, const std::string &_help, const char &_abbr) {
-    if(flags.find(_name) == flags.end() && options.find(_name) == options.end()) {
-        ArgFlag *argf = new ArgFlag(_help);
-        flags.insert({_name, argf});
-        if(_abbr != '\0') {
-            std::string temp;
-            temp += _abbr;
-            flags_abbr.insert({temp, _name});
-        }
+std::size_t ArgNames::add(std::string_view _name) {
+    std::size_t handle = ends.size();
+    pool.append(_name);
+    ends.push_back(pool.size());
+    // kept at most half full
+    if(ends.size()*2 > slots.size()) {
+        rehash(slots.empty() ? 16 : slots.size()*2);
     }else {
-        throw args::duplicate_argument(_name);
+        const std::size_t mask = slots.size()-1;
+        std::size_t i = std::hash<std::string_view>()(_name) & mask;
+        while(slots[i] != 0) {
+            i = (i+1) & mask;
+        }
+        slots[i] = handle+1;
     }
+    return handle;
 }
 
-void ArgParser::addOption(
-    const std::string &_name,
-    const std::string &_help,
-    const char &_abbr,
-    const std::string &_defaults_to,
-    const std::vector<std::string> &_allowed
-) {
-    if(options.find(_name) == options.end() && flags.find(_name) == flags.end()) {
-        ArgOption *argo = new ArgOption(_help, _defaults_to, _allowed);
-        options.insert({_name, argo});
-        if(_abbr != '\0') {
-            std::string temp;
-            temp += _abbr;
-            options_abbr.insert({temp, _name});
+std::size_t ArgNames::find(std::string_view _name) const {
+    if(slots.empty()) {
+        return npos;
+    }
+    const std::size_t mask = slots.size()-1;
+    for(std::size_t i = std::hash<std::string_view>()(_name) & mask; slots[i] != 0; i = (i+1) & mask) {
+        if((*this)[slots[i]-1] == _name) {
+            return slots[i]-1;
         }
-    }else {
-        throw args::duplicate_argument(_name);
     }
+    return npos;
 }
 
-void ArgParser::addCommand(const std::string &_name, const std::string &_help) {
-    if(commands.find(_name) == commands.end()) {
-        commands.insert({_name, _help});
-    }else {
-        throw args::duplicate_argument(_name);
+std::string_view ArgNames::operator[](const std::size_t _handle) const {
+    std::size_t begin = _handle == 0 ? 0 : ends[_handle-1];
+    return std::string_view(pool.data()+begin, ends[_handle]-begin);
+}
+
+std::size_t ArgNames::size() const {
+    return ends.size();
+}
+
+bool ArgNames::empty() const {
+    return ends.empty();
+}
+
+std::size_t ArgNames::footprint() const {
+    return ArgFootprint::of(pool)+ends.capacity()*sizeof(std::size_t)+slots.capacity()*sizeof(std::uint32_t);
+}
+
+ArgAllowedFile::ArgAllowedFile(const std::string &_path, const ArgNames::allocator_type &_alloc) : path(_path), values(_alloc) {}
+
+ArgSubcommand::ArgSubcommand(std::function<void(ArgParser &)> _factory) : factory(std::move(_factory)) {}
+
+// Command
+ArgCommand::ArgCommand(std::string_view _help, const allocator_type &_alloc) : help(_help, _alloc) {}
+
+ArgCommand::ArgCommand(const ArgCommand &_other, const allocator_type &_alloc) : help(_other.help, _alloc), scope(_other.scope), handler(_other.handler) {}
+
+ArgCommand::ArgCommand(ArgCommand &&_other, const allocator_type &_alloc) : help(std::move(_other.help), _alloc), scope(std::move(_other.scope)), handler(std::move(_other.handler)) {}
+
+std::size_t ArgFootprint::total() const {
+    return names+definitions+indexes+help;
+}
+
+// Definitions
+ArgDefinitions::ArgDefinitions(const allocator_type &_alloc) : flag_names(_alloc), flags(_alloc), option_names(_alloc), options(_alloc), command_names(_alloc), commands(_alloc), env(_alloc), env_targets(_alloc), long_names(_alloc), command_order(_alloc) {}
+
+ArgDefinitions::ArgDefinitions(const ArgDefinitions &_other, const allocator_type &_alloc) :
+    flag_names(_other.flag_names, _alloc),
+    flags(_other.flags, _alloc),
+    option_names(_other.option_names, _alloc),
+    options(_other.options, _alloc),
+    command_names(_other.command_names, _alloc),
+    commands(_other.commands, _alloc),
+    counters(_other.counters),
+    maps(_other.maps),
+    env(_other.env, _alloc),
+    env_targets(_other.env_targets, _alloc),
+    long_names(_other.long_names, _alloc),
+    command_order(_other.command_order, _alloc)
+{
+    std::memcpy(flags_abbr, _other.flags_abbr, sizeof(flags_abbr));
+    std::memcpy(options_abbr, _other.options_abbr, sizeof(options_abbr));
+}
+
+ArgDefinitions::allocator_type ArgDefinitions::get_allocator() const {
+    return flags.get_allocator();
+}
+
+std::size_t ArgDefinitions::findFlag(std::string_view _name) const {
+    return flag_names.find(_name);
+}
+
+std::size_t ArgDefinitions::findOption(std::string_view _name) const {
+    return option_names.find(_name);
+}
+
+std::size_t ArgDefinitions::findFlagAbbr(std::string_view _abbr) const {
+    return _abbr.size() == 1 ? std::size_t(flags_abbr[static_cast<unsigned char>(_abbr[0])])-1 : npos;
+}
+
+std::size_t ArgDefinitions::findOptionAbbr(std::string_view _abbr) const {
+    return _abbr.size() == 1 ? std::size_t(options_abbr[static_cast<unsigned char>(_abbr[0])])-1 : npos;
+}
+
+std::size_t ArgDefinitions::findCommand(std::string_view _name) const {
+    return command_names.find(_name);
+}
+
+std::string_view ArgDefinitions::longName(const std::size_t _target) const {
+    return _target & 1 ? option_names[_target >> 1] : flag_names[_target >> 1];
+}
+
+void ArgDefinitions::index(const std::size_t _target) {
+    std::string_view name = longName(_target);
+    auto at = std::upper_bound(long_names.begin(), long_names.end(), name, [this](std::string_view _name, std::uint32_t _t) {
+        return _name < longName(_t);
+    });
+    long_names.insert(at, static_cast<std::uint32_t>(_target));
+}
+
+std::pair<std::size_t, std::size_t> ArgDefinitions::prefixed(std::string_view _prefix) const {
+    auto first = std::lower_bound(long_names.begin(), long_names.end(), _prefix, [this](std::uint32_t _t, std::string_view _p) {
+        return longName(_t) < _p;
+    });
+    // names starting with _prefix sort before any name greater than it in its first characters
+    auto last = std::upper_bound(first, long_names.end(), _prefix, [this](std::string_view _p, std::uint32_t _t) {
+        return _p < longName(_t).substr(0, _p.size());
+    });
+    return {std::size_t(first-long_names.begin()), std::size_t(last-long_names.begin())};
+}
+
+std::size_t ArgDefinitions::findPrefix(std::string_view _prefix) const {
+    std::pair<std::size_t, std::size_t> range = prefixed(_prefix);
+    if(range.first == range.second) {
+        return npos;
+    }
+    // an exact name is never ambiguous, and sorts first
+    if(range.second-range.first == 1 || longName(long_names[range.first]) == _prefix) {
+        return long_names[range.first];
     }
+    std::vector<std::string> candidates;
+    for(std::size_t i = range.first; i < range.second; ++i) {
+        candidates.emplace_back(longName(long_names[i]));
+    }
+    throw args::ambiguous_argument(std::string(_prefix), candidates);
 }
 
-std::string ArgParser::help() {
-    std::string helpful;
-    if(!name.empty()) {
-        helpful += name;
+void ArgDefinitions::indexCommand(const std::size_t _handle) {
+    std::string_view name = command_names[_handle];
+    auto at = std::upper_bound(command_order.begin(), command_order.end(), name, [this](std::string_view _name, std::uint32_t _c) {
+        return _name < command_names[_c];
+    });
+    command_order.insert(at, static_cast<std::uint32_t>(_handle));
+}
+
+std::pair<std::size_t, std::size_t> ArgDefinitions::prefixedCommands(std::string_view _prefix) const {
+    auto first = std::lower_bound(command_order.begin(), command_order.end(), _prefix, [this](std::uint32_t _c, std::string_view _p) {
+        return command_names[_c] < _p;
+    });
+    auto last = std::upper_bound(first, command_order.end(), _prefix, [this](std::string_view _p, std::uint32_t _c) {
+        return _p < command_names[_c].substr(0, _p.size());
+    });
+    return {std::size_t(first-command_order.begin()), std::size_t(last-command_order.begin())};
+}
+
+// Parser internals
+namespace {
+#ifndef _WIN32
+    std::uint64_t modifiedAt(const struct stat &_info) {
+    #ifdef __APPLE__
+        return std::uint64_t(_info.st_mtimespec.tv_sec)*1000000000+_info.st_mtimespec.tv_nsec;
+    #else
+        return std::uint64_t(_info.st_mtim.tv_sec)*1000000000+_info.st_mtim.tv_nsec;
+    #endif
     }
-    if(!description.empty()) {
-        helpful += " - ";
-        if(description.length() > max_line_length-name.length()-3) {
-            std::size_t desc_length = description.length();
-            std::size_t last = 0;
-            int line_length = max_line_length-name.length()-3;
-            std::string indent;
-            for(std::size_t i = 0; i < name.length()+3; ++i) {
-                indent += " ";
+#endif
+
+    // Size and modification time of the file at _path, false if it cannot be read
+    bool fileStamp(const std::string &_path, std::uint64_t &_size, std::uint64_t &_modified) {
+#ifdef _WIN32
+        WIN32_FILE_ATTRIBUTE_DATA info;
+        if(!GetFileAttributesExA(_path.c_str(), GetFileExInfoStandard, &info)) {
+            return false;
+        }
+        _size = (std::uint64_t(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+        _modified = (std::uint64_t(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+        struct stat info;
+        if(stat(_path.c_str(), &info) == -1) {
+            return false;
+        }
+        _size = info.st_size;
+        _modified = modifiedAt(info);
+#endif
+        return true;
+    }
+
+    bool space(const char _c) {
+        return _c == ' ' || _c == '\t' || _c == '\n' || _c == '\r' || _c == '\v' || _c == '\f';
+    }
+
+    // Splits _line into arguments in place, with the quoting of response files,
+    // and points _argv at them; false if a quote is not closed
+    bool splitLine(std::string &_line, std::vector<const char*> &_argv) {
+        _argv.clear();
+        char *p = &_line[0];
+        char *end = p+_line.size();
+        while(true) {
+            while(p != end && space(*p)) {
+                ++p;
             }
-            std::size_t tk = description.rfind(" ", last+line_length);
-            if(tk != std::string::npos) {
-                helpful += description.substr(last, tk-last) + '\n';
-                desc_length -= tk-last-1;
-                last = tk+1;
+            if(p == end) {
+                return true;
             }
-            while(desc_length > line_length) {
-                std::size_t token;
-                if(last+line_length >= last+desc_length) {
-                    helpful += indent + description.substr(last) + '\n';
-                    break;
-                }else {
-                    token = description.rfind(" ", last+line_length);
-                }
-                if(token != std::string::npos && token > last) {
-                    helpful += indent + description.substr(last, token-last) + '\n';
-                    desc_length -= token-last-1;
-                    last = token+1;
+            // unquoting only ever shortens the argument, so it is done in place
+            char *out = p;
+            _argv.push_back(out);
+            while(p != end && !space(*p)) {
+                if(*p == '\\') {
+                    if(++p != end) {
+                        *out++ = *p++;
+                    }
+                }else if(*p == '\'') {
+                    char *close = static_cast<char*>(std::memchr(p+1, '\'', end-p-1));
+                    if(close == nullptr) {
+                        return false;
+                    }
+                    out = std::copy(p+1, close, out);
+                    p = close+1;
+                }else if(*p == '"') {
+                    for(++p; p != end && *p != '"'; ++p) {
+                        if(*p == '\\' && p+1 != end && (p[1] == '"' || p[1] == '\\')) {
+                            ++p;
+                        }
+                        *out++ = *p;
+                    }
+                    if(p == end) {
+                        return false;
+                    }
+                    ++p;
                 }else {
-                    helpful += indent + description.substr(last) + '\n';
-                    break;
+                    *out++ = *p++;
                 }
             }
-            helpful += indent + description.substr(last) + '\n';
-        }else {
-            helpful += description + '\n';
+            // the separator, or the string's own terminator at the end
+            bool last = p == end;
+            *out = '\0';
+            if(last) {
+                return true;
+            }
+            ++p;
         }
     }
-    helpful += "\n";
 
-    if(!commands.empty()) {
-        helpful += "COMMANDS\n\n";
-        for(auto i = commands.begin(); i != commands.end(); ++i) {
-            helpful += "    "+i->first+'\n';
-            std::string indent = "        ";
-            if(i->second.length() > max_line_length-8) {
-                splitDesc(helpful, i->second);
-            }else {
-                helpful += indent + i->second + '\n';
-            }
-            helpful += '\n';
+    std::string_view trim(std::string_view _s) {
+        const char *space = " \t\r\v\f";
+        std::size_t first = _s.find_first_not_of(space);
+        if(first == std::string_view::npos) {
+            return std::string_view();
         }
+        return _s.substr(first, _s.find_last_not_of(space)-first+1);
     }
+}
 
-    if(!flags.empty()) {
-        helpful += "FLAGS\n\n";
-        for(auto i = flags.begin(); i != flags.end(); ++i) {
-            helpful += "    --"+i->first;
-            std::string abbr = findFlagAbbr(i->first);
-            if(!abbr.empty()) {
-                helpful += ", -"+abbr;
-            }
-            // helpful += "\n        "+i->second->help+"\n\n";
-            helpful += '\n';
-            std::string indent = "        ";
-            if(i->second->help.length() > max_line_length-8) {
-                splitDesc(helpful, i->second->help);
-            }else {
-                helpful += indent + i->second->help + '\n';
-            }
-            helpful += '\n';
+class ArgParser::HelpText {
+    public:
+        int width;
+        std::string text;
+};
+
+// Every flag, option and command name in sorted order, as handle*4 plus 0
+// for a flag, 1 for an option and 2 for a command. Names sharing a prefix
+// are next to each other, so the list is searched like a trie.
+class ArgParser::NameIndex {
+    public:
+        std::vector<std::uint32_t> names;
+        // letters each name has in common with the one before it
+        std::vector<std::uint32_t> shared;
+        // position of the first name after it that shares fewer letters with
+        // the one before, so the names starting with a prefix are passed over
+        // in at most one jump per letter of the prefix
+        std::vector<std::uint32_t> next;
+};
+
+// A response file mapped into memory. Tokens are read straight out of the
+// mapping, only the ones with quotes or backslashes are copied to unescape them.
+class ArgParser::ResponseFile {
+    private:
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+        const char *data = nullptr;
+        std::size_t size = 0;
+        std::size_t pos = 0;
+
+        const bool config;
+
+        static bool space(const char _c) {
+            return _c == ' ' || _c == '\t' || _c == '\n' || _c == '\r' || _c == '\v' || _c == '\f';
         }
-    }
 
-    if(!options.empty()) {
+        [[noreturn]] void fail(const std::string &_reason) const {
+            if(config) {
+                throw args::config_error(path, _reason);
+            }
+            throw args::response_file_error(path, _reason);
+        }
+
+    public:
+        const std::string path;
+        // identifies the file on disk, whatever path it was opened with
+        std::uint64_t device = 0;
+        std::uint64_t inode = 0;
+        // only compared, to tell whether the file changed
+        std::uint64_t modified = 0;
+        // unescaped tokens, when they have to outlive the parse
+        std::deque<std::string> unescaped;
+
+        // Errors are reported as args::config_error if _config is set
+        ResponseFile(const std::string &_path, const bool _config = false) : config(_config), path(_path) {
+#ifdef _WIN32
+            file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            BY_HANDLE_FILE_INFORMATION info;
+            if(file == INVALID_HANDLE_VALUE || !GetFileInformationByHandle(file, &info)) {
+                if(file != INVALID_HANDLE_VALUE) {
+                    CloseHandle(file);
+                }
+                fail("cannot open file");
+            }
+            device = info.dwVolumeSerialNumber;
+            inode = (std::uint64_t(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+            modified = (std::uint64_t(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+            size = (std::uint64_t(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+            if(size != 0) {
+                mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                data = mapping != nullptr ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+                if(data == nullptr) {
+                    if(mapping != nullptr) {
+                        CloseHandle(mapping);
+                    }
+                    CloseHandle(file);
+                    fail("cannot map file");
+                }
+            }
+#else
+            int fd = open(path.c_str(), O_RDONLY);
+            struct stat info;
+            if(fd == -1 || fstat(fd, &info) == -1) {
+                std::string reason = std::strerror(errno);
+                if(fd != -1) {
+                    close(fd);
+                }
+                fail(reason);
+            }
+            device = info.st_dev;
+            inode = info.st_ino;
+            modified = modifiedAt(info);
+            size = info.st_size;
+            if(size != 0) {
+                void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(mapped == MAP_FAILED) {
+                    std::string reason = std::strerror(errno);
+                    close(fd);
+                    fail(reason);
+                }
+                madvise(mapped, size, MADV_SEQUENTIAL);
+                data = static_cast<const char*>(mapped);
+            }
+            // the mapping stays valid without the descriptor
+            close(fd);
+#endif
+        }
+
+        ResponseFile(const ResponseFile&) = delete;
+        ResponseFile& operator=(const ResponseFile&) = delete;
+
+        std::string_view text() const {
+            return std::string_view(data, size);
+        }
+
+        ~ResponseFile() {
+#ifdef _WIN32
+            if(data != nullptr) {
+                UnmapViewOfFile(data);
+                CloseHandle(mapping);
+            }
+            CloseHandle(file);
+#else
+            if(data != nullptr) {
+                munmap(const_cast<char*>(data), size);
+            }
+#endif
+        }
+
+        // Reads the next token with shell-like quoting: whitespace separates
+        // tokens, '...' is taken literally, "..." allows \" and \\, and a
+        // backslash outside quotes escapes any character. A token that has to
+        // be unescaped is written to _buffer, or kept in unescaped if it is null.
+        bool next(std::string_view &_arg, std::string *_buffer) {
+            const char *p = data+pos;
+            const char *end = data+size;
+            while(p != end && space(*p)) {
+                ++p;
+            }
+            if(p == end) {
+                pos = size;
+                return false;
+            }
+
+            const char *start = p;
+            while(p != end && !space(*p) && *p != '\'' && *p != '"' && *p != '\\') {
+                ++p;
+            }
+            if(p == end || space(*p)) {
+                _arg = std::string_view(start, p-start);
+                pos = p-data;
+                return true;
+            }
+
+            std::string &buffer = _buffer != nullptr ? *_buffer : unescaped.emplace_back();
+            buffer.assign(start, p);
+            while(p != end && !space(*p)) {
+                if(*p == '\\') {
+                    if(++p != end) {
+                        buffer += *p++;
+                    }
+                }else if(*p == '\'') {
+                    const char *close = static_cast<const char*>(std::memchr(p+1, '\'', end-p-1));
+                    if(close == nullptr) {
+                        throw args::response_file_error(path, "unterminated quote");
+                    }
+                    buffer.append(p+1, close);
+                    p = close+1;
+                }else if(*p == '"') {
+                    for(++p; p != end && *p != '"'; ++p) {
+                        if(*p == '\\' && p+1 != end && (p[1] == '"' || p[1] == '\\')) {
+                            ++p;
+                        }
+                        buffer += *p;
+                    }
+                    if(p == end) {
+                        throw args::response_file_error(path, "unterminated quote");
+                    }
+                    ++p;
+                }else {
+                    buffer += *p++;
+                }
+            }
+            _arg = buffer;
+            pos = p-data;
+            return true;
+        }
+};
+
+// Yields the arguments one at a time. With response files enabled an @file
+// argument is replaced by the arguments in file, which may contain more
+// @files; a file that ends up including itself is an error.
+class ArgParser::Source {
+    private:
+        const std::string *strings = nullptr;
+        const char *const *argv = nullptr;
+        std::size_t size;
+        std::size_t i = 0;
+        bool expand = false;
+        std::vector<std::shared_ptr<const void>> *keep = nullptr;
+        std::vector<std::shared_ptr<ResponseFile>> files;
+        // finished files stay mapped until the following call, because an
+        // option and its value can come from different files
+        std::vector<std::shared_ptr<ResponseFile>> retired;
+        // an option and its value may both need unescaping
+        std::string buffers[2];
+        bool turn = false;
+
+        void open(std::string_view _path) {
+            auto file = std::make_shared<ResponseFile>(std::string(_path));
+            for(const auto &f : files) {
+                if(f->device == file->device && f->inode == file->inode) {
+                    throw args::response_file_error(file->path, "it includes itself");
+                }
+            }
+            if(keep != nullptr) {
+                keep->push_back(file);
+            }
+            files.push_back(std::move(file));
+        }
+
+    public:
+        // Keeps _owner alive as long as the results, if they point into it
+        void hold(std::shared_ptr<const void> _owner) {
+            if(keep != nullptr) {
+                keep->push_back(std::move(_owner));
+            }
+        }
+
+        Source(const std::vector<std::string> &_args, const bool _expand, std::vector<std::shared_ptr<const void>> *_keep = nullptr) : strings(_args.data()), size(_args.size()), expand(_expand), keep(_keep) {}
+        Source(const char *const *_argv, const std::size_t _argc, const bool _expand, std::vector<std::shared_ptr<const void>> *_keep = nullptr) : argv(_argv), size(_argc), expand(_expand), keep(_keep) {}
+
+        bool next(std::string_view &_arg) {
+            retired.clear();
+            while(true) {
+                if(!files.empty()) {
+                    if(!files.back()->next(_arg, keep != nullptr ? nullptr : &buffers[turn = !turn])) {
+                        retired.push_back(std::move(files.back()));
+                        files.pop_back();
+                        continue;
+                    }
+                }else if(i < size) {
+                    if(strings != nullptr) {
+                        _arg = strings[i];
+                    }else {
+                        _arg = argv[i] != nullptr ? std::string_view(argv[i]) : std::string_view();
+                    }
+                    ++i;
+                }else {
+                    return false;
+                }
+
+                if(expand && _arg.size() > 1 && _arg[0] == '@') {
+                    open(_arg.substr(1));
+                }else {
+                    return true;
+                }
+            }
+        }
+};
+
+// A config file as loaded by loadConfig: every value it sets, already checked
+// and converted, to be passed on at the start of each parse. The file is only
+// mapped while it is read; the values are copied into one buffer, so editing
+// the file cannot change them under a parse that is using them.
+class ArgParser::ConfigFile {
+    public:
+        struct Entry {
+            // flag (handle*2) or option (handle*2+1)
+            std::uint32_t target;
+            std::uint32_t offset;
+            std::uint32_t length;
+            bool converted;
+            args::typed_value typed;
+        };
+
+        const std::string path;
+        const std::string section;
+        std::uint64_t size = 0;
+        std::uint64_t modified = 0;
+        std::string values;
+        std::vector<Entry> entries;
+
+        ConfigFile(const std::string &_path, const std::string &_section) : path(_path), section(_section) {}
+
+        std::string_view value(const Entry &_entry) const {
+            return std::string_view(values).substr(_entry.offset, _entry.length);
+        }
+};
+
+class ArgParser::ResultsSink : public ArgVisitor {
+    private:
+        ArgResults &r;
+        std::size_t positionals = 0;
+
+    public:
+        // the layer the values passed on come from
+        std::uint8_t layer = argv_layer;
+
+        ResultsSink(ArgResults &_r) : r(_r) {
+            r.command.clear();
+        }
+
+        void flag(const std::size_t _handle) {
+            r.flag.set(_handle, layer);
+        }
+
+        void option(const std::size_t _handle, std::string_view _value) {
+            r.option.values[_handle].assign(_value);
+            r.repeated.add(_handle, _value, layer);
+            r.map.add(_handle, _value, layer);
+        }
+
+        void typed(const std::size_t _handle, const args::typed_value &_value) {
+            r.typed.values[_handle] = _value;
+        }
+
+        void positional(std::string_view _arg) {
+            if(positionals < r.positional.size()) {
+                r.positional[positionals].assign(_arg);
+            }else if(!r.spare.empty()) {
+                r.positional.push_back(std::move(r.spare.back()));
+                r.spare.pop_back();
+                r.positional.back().assign(_arg);
+            }else {
+                r.positional.emplace_back(_arg);
+            }
+            ++positionals;
+        }
+
+        // Moves whatever the previous parse left past the end to spare
+        void finish() {
+            while(r.positional.size() > positionals) {
+                r.spare.push_back(std::move(r.positional.back()));
+                r.positional.pop_back();
+            }
+        }
+
+        void command(std::string_view _arg) {
+            r.command.assign(_arg);
+        }
+};
+
+class ArgParser::ViewSink : public ArgVisitor {
+    private:
+        ArgResultsView &r;
+
+    public:
+        std::uint8_t layer = argv_layer;
+
+        ViewSink(ArgResultsView &_r) : r(_r) {
+            r.positional.clear();
+            r.command = std::string_view();
+            r.files.clear();
+        }
+
+        void flag(const std::size_t _handle) {
+            r.flag.set(_handle, layer);
+        }
+
+        void option(const std::size_t _handle, std::string_view _value) {
+            r.option.values[_handle] = _value;
+            r.repeated.add(_handle, _value, layer);
+            r.map.add(_handle, _value, layer);
+        }
+
+        void typed(const std::size_t _handle, const args::typed_value &_value) {
+            r.typed.values[_handle] = _value;
+        }
+
+        void positional(std::string_view _arg) {
+            r.positional.push_back(_arg);
+        }
+
+        void finish() {}
+
+        void command(std::string_view _arg) {
+            r.command = _arg;
+        }
+};
+
+class ArgParser::PmrSink : public ArgVisitor {
+    private:
+        ArgPmrResults &r;
+
+    public:
+        std::uint8_t layer = argv_layer;
+
+        PmrSink(ArgPmrResults &_r) : r(_r) {
+            r.positional.clear();
+            r.command.clear();
+        }
+
+        void flag(const std::size_t _handle) {
+            r.flag.set(_handle, layer);
+        }
+
+        void option(const std::size_t _handle, std::string_view _value) {
+            r.option.values[_handle].assign(_value.data(), _value.size());
+            r.repeated.add(_handle, _value, layer);
+            r.map.add(_handle, _value, layer);
+        }
+
+        void typed(const std::size_t _handle, const args::typed_value &_value) {
+            r.typed.values[_handle] = _value;
+        }
+
+        void positional(std::string_view _arg) {
+            r.positional.emplace_back(_arg);
+        }
+
+        void finish() {}
+
+        void command(std::string_view _arg) {
+            r.command.assign(_arg.data(), _arg.size());
+        }
+};
+
+// Parser
+ArgParser::ArgParser(const std::string &_name, const std::string &_description, std::pmr::memory_resource *_resource) : defs(std::allocate_shared<ArgDefinitions>(std::pmr::polymorphic_allocator<ArgDefinitions>(_resource))), name(_name), description(_description) {}
+
+ArgDefinitions& ArgParser::edit() {
+    // results still pointing at the definitions keep their own copy
+    if(defs.use_count() > 1) {
+        defs = std::allocate_shared<ArgDefinitions>(std::pmr::polymorphic_allocator<ArgDefinitions>(defs->get_allocator()), *defs);
+    }
+    help_cache.reset();
+    name_index.reset();
+    return *defs;
+}
+
+template<class R>
+void ArgParser::reset(R &_r, const std::size_t _args) const {
+    using S = typename std::decay<decltype(_r.command)>::type;
+    ArgFlagValues &_f = _r.flag;
+    ArgOptionValues<S> &_o = _r.option;
+    ArgTypedValues &_t = _r.typed;
+    _f.defs = defs;
+    _f.bits.assign((defs->flags.size()+63)/64, 0);
+    _f.counts.assign(defs->counters, 0);
+    _f.layers.assign(defs->counters, 0);
+    _r.repeated.clear(defs);
+    _r.map.clear(defs, _args);
+    _o.defs = defs;
+    _o.values.resize(defs->options.size());
+    _o.slices.clear();
+    _o.starts.assign(defs->options.size()+1, 0);
+    _t.defs = defs;
+    _t.values.resize(defs->options.size());
+    for(std::size_t i = 0; i < defs->options.size(); ++i) {
+        _t.values[i] = defs->options[i].typed_default;
+        const std::pmr::string &d = defs->options[i].defaults_to;
+        if constexpr(std::is_same<S, std::string_view>::value) {
+            _o.values[i] = d;
+        }else {
+            _o.values[i].assign(d.data(), d.size());
+        }
+    }
+}
+
+// Checks _value against the allowed values and converts it before passing it
+// on; _name is the option or variable it came from, for the error
+void ArgParser::acceptValue(const std::size_t _handle, std::string_view _name, std::string_view _value, ArgVisitor &_r) const {
+    const ArgOption &valid_option = defs->options[_handle];
+    const ArgNames &allowed = allowedValues(valid_option);
+    // an empty file allows nothing, an empty list anything
+    const bool restricted = !allowed.empty() || valid_option.allowed_file != nullptr;
+    const bool list = valid_option.delimiter != '\0';
+    args::typed_value typed = {};
+    if(restricted && list) {
+        forEachElement(_value, valid_option.delimiter, [&](std::string_view _element) {
+            if(allowed.find(_element) == ArgNames::npos) {
+                throw args::invalid_value(std::string(_name), std::string(_element));
+            }
+        });
+    }else if(restricted) {
+        std::size_t valid_value = allowed.find(_value);
+        if(valid_value == ArgNames::npos) {
+            throw args::invalid_value(std::string(_name), std::string(_value));
+        }
+        typed = {std::int64_t(valid_value), double(valid_value)};
+    }
+    if(valid_option.kind != args::value_kind::string && valid_option.kind != args::value_kind::choice && !args::convert(valid_option.kind, _value, typed)) {
+        throw args::invalid_value(std::string(_name), std::string(_value));
+    }
+    _r.option(_handle, _value);
+    if(valid_option.kind != args::value_kind::string || (restricted && !list)) {
+        _r.typed(_handle, typed);
+    }
+}
+
+// One pass over the environment, looking each name up among the bound ones
+void ArgParser::readEnvironment(ArgVisitor &_r) const {
+    for(char **entry = environment(); entry != nullptr && *entry != nullptr; ++entry) {
+        const char *equals = std::strchr(*entry, '=');
+        if(equals == nullptr) {
+            continue;
+        }
+        std::size_t variable = defs->env.find(std::string_view(*entry, equals-*entry));
+        std::string_view value(equals+1);
+        // an empty variable counts as unset
+        if(variable == ArgNames::npos || value.empty()) {
+            continue;
+        }
+        std::uint32_t target = defs->env_targets[variable];
+        if(target & 1) {
+            acceptValue(target >> 1, defs->env[variable], value, _r);
+        }else {
+            args::typed_value set;
+            if(!args::convert(args::value_kind::boolean, value, set)) {
+                throw args::invalid_value(std::string(defs->env[variable]), std::string(value));
+            }
+            if(set.integer != 0) {
+                _r.flag(target >> 1);
+            }
+        }
+    }
+}
+
+bool ArgParser::validateOption(std::string_view _sa, std::size_t _equals, Source &_src, ArgVisitor &_r) const {
+    std::string_view val;
+    bool has_val = false;
+    if(_sa.length() >= 2 && _equals != std::string_view::npos) {
+        if(_equals != _sa.size()-1) {
+            val = _sa.substr(_equals+1);
+            _sa = _sa.substr(0, _equals);
+            has_val = true;
+        }else {
+            throw args::missing_value(std::string(_sa.substr(0, _equals)));
+        }
+    }
+
+    std::size_t found_option = defs->findOption(_sa);
+    if(found_option == ArgDefinitions::npos) {
+        found_option = defs->findOptionAbbr(_sa);
+    }
+
+    if(found_option != ArgDefinitions::npos) {
+        takeValue(found_option, _sa, val, has_val, _src, _r);
+
+        return true;
+    }else {
+        return false;
+    }
+}
+
+void ArgParser::takeValue(const std::size_t _option, std::string_view _name, std::string_view _val, const bool _has_val, Source &_src, ArgVisitor &_r) const {
+    // the value is only taken from the next argument once the option is known
+    if(!_has_val && !_src.next(_val)) {
+        _val = std::string_view();
+    }
+    // a negative number is the value of a numeric option, not an option
+    const args::value_kind kind = defs->options[_option].kind;
+    const bool negative = (kind == args::value_kind::integer || kind == args::value_kind::real) && _val.size() > 1 && (std::isdigit(static_cast<unsigned char>(_val[1])) || _val[1] == '.');
+    if(_val.empty() || (_val[0] == '-' && !negative)) {
+        throw args::missing_value(std::string(_name));
+    }
+    acceptValue(_option, _name, _val, _r);
+}
+
+// Only tried once no long name matches exactly
+bool ArgParser::validatePrefix(std::string_view _sa, std::size_t _equals, Source &_src, ArgVisitor &_r) const {
+    std::size_t target = defs->findPrefix(_sa.substr(0, _equals));
+    if(target == ArgDefinitions::npos) {
+        return false;
+    }
+    if((target & 1) == 0) {
+        // a flag takes no value
+        if(_equals != std::string_view::npos) {
+            return false;
+        }
+        _r.flag(target >> 1);
+        return true;
+    }
+    const bool has_val = _equals != std::string_view::npos;
+    takeValue(target >> 1, defs->longName(target), has_val ? _sa.substr(_equals+1) : std::string_view(), has_val, _src, _r);
+    return true;
+}
+
+// Done once the last value of each option is known, so an option given twice
+// is only split once
+template<class S>
+void ArgParser::split(ArgOptionValues<S> &_o) const {
+    for(std::size_t h = 0; h < defs->options.size(); ++h) {
+        const char delimiter = defs->options[h].delimiter;
+        if(delimiter != '\0' && !_o.values[h].empty()) {
+            std::string_view value(_o.values[h].data(), _o.values[h].size());
+            forEachElement(value, delimiter, [&](std::string_view _element) {
+                _o.slices.push_back({static_cast<std::uint32_t>(_element.data()-value.data()), static_cast<std::uint32_t>(_element.size())});
+            });
+        }
+        _o.starts[h+1] = static_cast<std::uint32_t>(_o.slices.size());
+    }
+}
+
+// -DNAME=1: the value of a map option can follow its abbreviation directly,
+// unless the whole of it names an option. -D=x gives it the value =x, whose
+// key is empty.
+bool ArgParser::validateAttached(std::string_view _sa, ArgVisitor &_r) const {
+    if(_sa.length() < 2 || defs->findOption(_sa.substr(0, _sa.find('='))) != ArgDefinitions::npos) {
+        return false;
+    }
+    std::size_t found_option = defs->findOptionAbbr(_sa.substr(0, 1));
+    if(found_option == ArgDefinitions::npos || !defs->options[found_option].map) {
+        return false;
+    }
+    acceptValue(found_option, _sa.substr(0, 1), _sa.substr(1), _r);
+    return true;
+}
+
+bool ArgParser::validateFlag(std::string_view _sa, ArgVisitor &_r) const {
+    std::size_t found_flag = defs->findFlag(_sa);
+    if(found_flag == ArgDefinitions::npos) {
+        found_flag = defs->findFlagAbbr(_sa);
+    }
+
+    if(found_flag != ArgDefinitions::npos) {
+        _r.flag(found_flag);
+        return true;
+    }else {
+        return false;
+    }
+}
+
+void ArgParser::splitDesc(std::string &_help, std::string_view _desc) const {
+    std::size_t desc_length = _desc.length();
+    std::size_t last = 0;
+    int line_length = max_line_length-8;
+    const char *indent = "        ";
+    while(desc_length > line_length) {
+        std::size_t token;
+        if(last+line_length >= last+desc_length) {
+            _help.append(indent).append(_desc, last, std::string::npos) += '\n';
+            break;
+        }else {
+            token = _desc.rfind(" ", last+line_length);
+        }
+        if(token != std::string::npos && token > last) {
+            _help.append(indent).append(_desc, last, token-last) += '\n';
+            desc_length -= token-last-1;
+            last = token+1;
+        }else {
+            _help.append(indent).append(_desc, last, std::string::npos) += '\n';
+            break;
+        }
+    }
+    _help.append(indent).append(_desc, last, std::string::npos) += '\n';
+}
+
+std::size_t ArgParser::addFlag(const std::string &_name, const std::string &_help, const char &_abbr) {
+    if(defs->findFlag(_name) == ArgDefinitions::npos && defs->findOption(_name) == ArgDefinitions::npos) {
+        ArgDefinitions &d = edit();
+        std::size_t handle = d.flags.size();
+        d.flags.emplace_back(_help);
+        d.flag_names.add(_name);
+        d.index(handle*2);
+        std::uint32_t &abbr = d.flags_abbr[static_cast<unsigned char>(_abbr)];
+        if(_abbr != '\0' && abbr == 0) {
+            abbr = handle+1;
+            d.flags[handle].abbr = _abbr;
+        }
+        return handle;
+    }else {
+        throw args::duplicate_argument(_name);
+    }
+}
+
+std::size_t ArgParser::addCounter(const std::string &_name, const std::string &_help, const char &_abbr) {
+    std::size_t handle = addFlag(_name, _help, _abbr);
+    defs->flags[handle].counter = ++defs->counters;
+    return handle;
+}
+
+std::size_t ArgParser::addOption(
+    const std::string &_name,
+    const std::string &_help,
+    const char &_abbr,
+    const std::string &_defaults_to,
+    const std::vector<std::string> &_allowed
+) {
+    if(defs->findOption(_name) == ArgDefinitions::npos && defs->findFlag(_name) == ArgDefinitions::npos) {
+        ArgDefinitions &d = edit();
+        std::size_t handle = d.options.size();
+        d.options.emplace_back(_help, _defaults_to, _allowed);
+        d.option_names.add(_name);
+        d.index(handle*2+1);
+        if(!_allowed.empty()) {
+            std::size_t index = d.options[handle].allowed.find(_defaults_to);
+            d.options[handle].typed_default = {std::int64_t(index), double(index)};
+        }
+        std::uint32_t &abbr = d.options_abbr[static_cast<unsigned char>(_abbr)];
+        if(_abbr != '\0' && abbr == 0) {
+            abbr = handle+1;
+            d.options[handle].abbr = _abbr;
+        }
+        return handle;
+    }else {
+        throw args::duplicate_argument(_name);
+    }
+}
+
+std::size_t ArgParser::addRepeatedOption(const std::string &_name, const std::string &_help, const char &_abbr, const std::vector<std::string> &_allowed) {
+    std::size_t handle = addOption(_name, _help, _abbr, "", _allowed);
+    defs->options[handle].repeated = true;
+    return handle;
+}
+
+std::size_t ArgParser::addListOption(
+    const std::string &_name,
+    const std::string &_help,
+    const char &_abbr,
+    const char _delimiter,
+    const std::string &_defaults_to,
+    const std::vector<std::string> &_allowed
+) {
+    std::size_t handle = addOption(_name, _help, _abbr, _defaults_to, _allowed);
+    ArgOption &option = defs->options[handle];
+    option.delimiter = _delimiter;
+    option.typed_default = {std::int64_t(ArgDefinitions::npos), 0.0};
+    return handle;
+}
+
+std::size_t ArgParser::addMapOption(const std::string &_name, const std::string &_help, const char &_abbr, const args::duplicate_keys _duplicates) {
+    std::size_t handle = addOption(_name, _help, _abbr);
+    ArgOption &option = defs->options[handle];
+    option.map = true;
+    option.duplicates = _duplicates;
+    ++defs->maps;
+    return handle;
+}
+
+std::size_t ArgParser::addTypedOption(
+    const std::string &_name,
+    const args::value_kind _kind,
+    const std::string &_help,
+    const char &_abbr,
+    const std::string &_defaults_to,
+    const std::vector<std::string> &_allowed
+) {
+    // the default is converted up front, so parsing never has to
+    args::typed_value typed = {std::int64_t(ArgDefinitions::npos), 0.0};
+    if(_kind == args::value_kind::choice) {
+        if(!_defaults_to.empty()) {
+            std::size_t i = std::find(_allowed.begin(), _allowed.end(), _defaults_to)-_allowed.begin();
+            if(i == _allowed.size()) {
+                throw args::invalid_value(_name, _defaults_to);
+            }
+            typed = {std::int64_t(i), double(i)};
+        }
+    }else if(_kind == args::value_kind::string || _defaults_to.empty()) {
+        typed = {};
+    }else if(!args::convert(_kind, _defaults_to, typed)) {
+        throw args::invalid_value(_name, _defaults_to);
+    }
+
+    std::size_t handle = addOption(_name, _help, _abbr, _defaults_to, _allowed);
+    ArgOption &option = defs->options[handle];
+    option.kind = _kind;
+    option.typed_default = typed;
+    return handle;
+}
+
+void ArgParser::allowFromFile(const std::string &_option, const std::string &_path) {
+    std::size_t handle = defs->findOption(_option);
+    if(handle == ArgDefinitions::npos) {
+        throw args::invalid_argument(_option);
+    }
+    ArgDefinitions &d = edit();
+    d.options[handle].allowed_file = std::make_shared<ArgAllowedFile>(_path, d.get_allocator());
+    d.options[handle].typed_default = {std::int64_t(ArgDefinitions::npos), 0.0};
+}
+
+void ArgParser::bindEnv(const std::string &_name, const std::string &_variable) {
+    std::size_t flag = defs->findFlag(_name);
+    std::size_t option = defs->findOption(_name);
+    if(flag == ArgDefinitions::npos && option == ArgDefinitions::npos) {
+        throw args::invalid_argument(_name);
+    }
+    std::uint32_t bound = flag != ArgDefinitions::npos ? defs->flags[flag].env : defs->options[option].env;
+    if(bound != 0 || defs->env.find(_variable) != ArgNames::npos) {
+        throw args::duplicate_argument(bound != 0 ? _name : _variable);
+    }
+    ArgDefinitions &d = edit();
+    std::uint32_t index = static_cast<std::uint32_t>(d.env.add(_variable));
+    if(flag != ArgDefinitions::npos) {
+        d.flags[flag].env = index+1;
+        d.env_targets.push_back(static_cast<std::uint32_t>(flag*2));
+    }else {
+        d.options[option].env = index+1;
+        d.env_targets.push_back(static_cast<std::uint32_t>(option*2+1));
+    }
+}
+
+std::shared_ptr<const ArgParser::ConfigFile> ArgParser::readConfig(const std::string &_path, const std::string &_section) const {
+    // collects what acceptValue passes on
+    class Recorder : public ArgVisitor {
+        public:
+            ConfigFile &file;
+
+            Recorder(ConfigFile &_file) : file(_file) {}
+
+            void flag(const std::size_t _handle) {
+                file.entries.push_back({static_cast<std::uint32_t>(_handle*2), 0, 0, false, {}});
+            }
+
+            void option(const std::size_t _handle, std::string_view _value) {
+                file.entries.push_back({static_cast<std::uint32_t>(_handle*2+1), static_cast<std::uint32_t>(file.values.size()), static_cast<std::uint32_t>(_value.size()), false, {}});
+                file.values.append(_value);
+            }
+
+            void typed(const std::size_t /*_handle*/, const args::typed_value &_value) {
+                file.entries.back().converted = true;
+                file.entries.back().typed = _value;
+            }
+    };
+
+    auto file = std::make_shared<ConfigFile>(_path, _section);
+    ResponseFile in(_path, true);
+    file->size = in.text().size();
+    file->modified = in.modified;
+    Recorder recorder(*file);
+
+    std::string_view text = in.text();
+    bool active = true;
+    for(std::size_t line = 1; !text.empty(); ++line) {
+        std::size_t end = text.find('\n');
+        std::string_view l = trim(text.substr(0, end));
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end+1);
+        std::string where = "line "+std::to_string(line)+": ";
+        if(l.empty() || l[0] == ';' || l[0] == '#') {
+            continue;
+        }
+        if(l[0] == '[') {
+            if(l.back() != ']') {
+                throw args::config_error(_path, where+"unterminated section name");
+            }
+            active = !_section.empty() && trim(l.substr(1, l.size()-2)) == _section;
+            continue;
+        }
+        if(!active) {
+            continue;
+        }
+
+        std::size_t equals = l.find('=');
+        std::string_view key = trim(l.substr(0, equals));
+        std::string_view value = equals != std::string_view::npos ? trim(l.substr(equals+1)) : std::string_view();
+        if(value.size() >= 2 && (value[0] == '"' || value[0] == '\'') && value.back() == value[0]) {
+            value = value.substr(1, value.size()-2);
+        }
+        std::size_t option = defs->findOption(key);
+        std::size_t flag = defs->findFlag(key);
+        try {
+            if(option != ArgDefinitions::npos) {
+                if(value.empty()) {
+                    throw args::config_error(_path, where+"no value for \""+std::string(key)+"\"");
+                }
+                acceptValue(option, key, value, recorder);
+            }else if(flag != ArgDefinitions::npos) {
+                // a flag on its own is set
+                args::typed_value set = {1, 1.0};
+                if(!value.empty() && !args::convert(args::value_kind::boolean, value, set)) {
+                    throw args::invalid_value(std::string(key), std::string(value));
+                }
+                if(set.integer != 0) {
+                    recorder.flag(flag);
+                }
+            }else {
+                throw args::config_error(_path, where+"unknown key \""+std::string(key)+"\"");
+            }
+        }catch(const args::invalid_value &e) {
+            throw args::config_error(_path, where+e.what());
+        }
+    }
+    return file;
+}
+
+void ArgParser::loadConfig(const std::string &_path, const std::string &_section) {
+    std::atomic_store(&config, readConfig(_path, _section));
+    has_config = true;
+}
+
+bool ArgParser::reloadConfig() {
+    std::shared_ptr<const ConfigFile> current = std::atomic_load(&config);
+    if(current == nullptr) {
+        return false;
+    }
+    std::uint64_t size;
+    std::uint64_t modified;
+    if(fileStamp(current->path, size, modified) && size == current->size && modified == current->modified) {
+        return false;
+    }
+    std::atomic_store(&config, readConfig(current->path, current->section));
+    return true;
+}
+
+const ArgNames& ArgParser::allowedValues(const ArgOption &_option) const {
+    if(_option.allowed_file == nullptr) {
+        return _option.allowed;
+    }
+    // a failed read leaves loaded unset, so the next parse tries again
+    ArgAllowedFile &file = *_option.allowed_file;
+    if(!file.loaded.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(file.loading);
+        if(!file.loaded.load(std::memory_order_relaxed)) {
+            ResponseFile in(file.path);
+            ArgNames values(file.values);
+            std::string buffer;
+            std::string_view value;
+            while(in.next(value, &buffer)) {
+                values.add(value);
+            }
+            file.values = values;
+            file.loaded.store(true, std::memory_order_release);
+        }
+    }
+    return file.values;
+}
+
+std::size_t ArgParser::addCommand(const std::string &_name, const std::string &_help) {
+    if(defs->findCommand(_name) == ArgDefinitions::npos) {
+        ArgDefinitions &d = edit();
+        d.commands.emplace_back(_help);
+        std::size_t handle = d.command_names.add(_name);
+        d.indexCommand(handle);
+        return handle;
+    }else {
+        throw args::duplicate_argument(_name);
+    }
+}
+
+std::size_t ArgParser::addCommand(const std::string &_name, const std::string &_help, std::function<int(const ArgResults &)> _handler) {
+    std::size_t handle = addCommand(_name, _help);
+    defs->commands[handle].handler = std::move(_handler);
+    return handle;
+}
+
+std::size_t ArgParser::addCommand(const std::string &_name, const std::string &_help, std::function<void(ArgParser &)> _factory, std::function<int(const ArgResults &)> _handler) {
+    std::size_t handle = addCommand(_name, _help);
+    ArgCommand &command = defs->commands[handle];
+    command.scope = std::make_shared<ArgSubcommand>(std::move(_factory));
+    command.handler = std::move(_handler);
+    return handle;
+}
+
+const ArgParser& ArgParser::subparser(const std::string &_name) const {
+    std::size_t handle = defs->findCommand(_name);
+    if(handle == ArgDefinitions::npos || defs->commands[handle].scope == nullptr) {
+        throw args::invalid_argument(_name);
+    }
+    return scope(handle);
+}
+
+const ArgParser& ArgParser::scope(const std::size_t _handle) const {
+    ArgSubcommand &command = *defs->commands[_handle].scope;
+    // a factory that throws leaves built unset, so the next parse tries again
+    if(!command.built.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(command.building);
+        if(!command.built.load(std::memory_order_relaxed)) {
+            std::string_view command_name = defs->command_names[_handle];
+            auto parser = std::make_shared<ArgParser>(name.empty() ? std::string(command_name) : name+" "+std::string(command_name), std::string(defs->commands[_handle].help), defs->get_allocator().resource());
+            parser->max_line_length = max_line_length;
+            parser->prefix_matching = prefix_matching;
+            command.factory(*parser);
+            command.parser = std::move(parser);
+            command.built.store(true, std::memory_order_release);
+        }
+    }
+    return *command.parser;
+}
+
+const ArgParser* ArgParser::enter(const std::size_t _handle) const {
+    if(_handle == ArgDefinitions::npos || defs->commands[_handle].scope == nullptr) {
+        return nullptr;
+    }
+    return &scope(_handle);
+}
+
+std::shared_ptr<const ArgParser::HelpText> ArgParser::layout() const {
+    std::shared_ptr<const HelpText> cached = std::atomic_load(&help_cache);
+    if(cached != nullptr && cached->width == max_line_length) {
+        return cached;
+    }
+
+    auto rendered = std::make_shared<HelpText>();
+    rendered->width = max_line_length;
+    std::string &helpful = rendered->text;
+    std::size_t estimate = name.length()+description.length()+64;
+    for(std::size_t i = 0; i < defs->commands.size(); ++i) {
+        estimate += defs->command_names[i].length()+defs->commands[i].help.length()+16;
+    }
+    for(std::size_t i = 0; i < defs->flags.size(); ++i) {
+        estimate += defs->flag_names[i].length()+defs->flags[i].help.length()+24;
+    }
+    for(std::size_t i = 0; i < defs->options.size(); ++i) {
+        estimate += defs->option_names[i].length()+defs->options[i].help.length()+24;
+        const ArgOption &option = defs->options[i];
+        estimate += option.allowed_file != nullptr ? option.allowed_file->path.length()+16 : option.allowed.footprint();
+    }
+    helpful.reserve(estimate);
+
+    if(!name.empty()) {
+        helpful += name;
+    }
+    if(!description.empty()) {
+        helpful += " - ";
+        if(description.length() > max_line_length-name.length()-3) {
+            std::size_t desc_length = description.length();
+            std::size_t last = 0;
+            int line_length = max_line_length-name.length()-3;
+            std::string indent(name.length()+3, ' ');
+            std::size_t tk = description.rfind(" ", last+line_length);
+            if(tk != std::string::npos) {
+                helpful.append(description, last, tk-last) += '\n';
+                desc_length -= tk-last-1;
+                last = tk+1;
+            }
+            while(desc_length > line_length) {
+                std::size_t token;
+                if(last+line_length >= last+desc_length) {
+                    helpful.append(indent).append(description, last, std::string::npos) += '\n';
+                    break;
+                }else {
+                    token = description.rfind(" ", last+line_length);
+                }
+                if(token != std::string::npos && token > last) {
+                    helpful.append(indent).append(description, last, token-last) += '\n';
+                    desc_length -= token-last-1;
+                    last = token+1;
+                }else {
+                    helpful.append(indent).append(description, last, std::string::npos) += '\n';
+                    break;
+                }
+            }
+            helpful.append(indent).append(description, last, std::string::npos) += '\n';
+        }else {
+            helpful.append(description) += '\n';
+        }
+    }
+    helpful += "\n";
+
+    if(!defs->commands.empty()) {
+        helpful += "COMMANDS\n\n";
+        for(std::size_t i = 0; i < defs->commands.size(); ++i) {
+            const ArgCommand &command = defs->commands[i];
+            helpful.append("    ").append(defs->command_names[i]) += '\n';
+            if(command.help.length() > max_line_length-8) {
+                splitDesc(helpful, command.help);
+            }else {
+                helpful.append("        ").append(command.help) += '\n';
+            }
+            helpful += '\n';
+        }
+    }
+
+    if(!defs->flags.empty()) {
+        helpful += "FLAGS\n\n";
+        for(std::size_t i = 0; i < defs->flags.size(); ++i) {
+            const ArgFlag &flag = defs->flags[i];
+            helpful.append("    --").append(defs->flag_names[i]);
+            if(flag.abbr != '\0') {
+                helpful.append(", -") += flag.abbr;
+            }
+            if(flag.env != 0) {
+                helpful.append(" (env ").append(defs->env[flag.env-1]) += ')';
+            }
+            helpful += '\n';
+            if(flag.help.length() > max_line_length-8) {
+                splitDesc(helpful, flag.help);
+            }else {
+                helpful.append("        ").append(flag.help) += '\n';
+            }
+            helpful += '\n';
+        }
+    }
+
+    if(!defs->options.empty()) {
         helpful += "OPTIONS\n\n";
-        for(auto i = options.begin(); i != options.end(); ++i) {
-            helpful += "    --"+i->first;
-            std::string abbr = findOptionAbbr(i->first);
-            if(!abbr.empty()) {
-                helpful += ", -"+abbr;
+        for(std::size_t i = 0; i < defs->options.size(); ++i) {
+            const ArgOption &option = defs->options[i];
+            helpful.append("    --").append(defs->option_names[i]);
+            if(option.abbr != '\0') {
+                helpful.append(", -") += option.abbr;
             }
-            if(!i->second->allowed.empty()) {
+            if(option.allowed_file != nullptr) {
+                helpful.append(" (values in ").append(option.allowed_file->path) += ')';
+            }else if(!option.allowed.empty()) {
                 helpful += " ";
-                for(std::size_t ii = 0; ii < i->second->allowed.size(); ++ii) {
-                    if(ii != i->second->allowed.size()-1) {
-                        helpful += i->second->allowed[ii]+"|";
-                    }else {
-                        helpful += i->second->allowed[ii];
+                for(std::size_t ii = 0; ii < option.allowed.size(); ++ii) {
+                    if(ii != 0) {
+                        helpful += '|';
                     }
+                    helpful += option.allowed[ii];
                 }
             }
+            if(option.delimiter != '\0') {
+                helpful.append(" (list separated by '") += option.delimiter;
+                helpful += "')";
+            }else if(option.map) {
+                helpful += " key=value";
+            }
+            if(option.env != 0) {
+                helpful.append(" (env ").append(defs->env[option.env-1]) += ')';
+            }
             helpful += '\n';
-            std::string indent = "        ";
-            if(i->second->help.length() > max_line_length-8) {
-                splitDesc(helpful, i->second->help);
+            if(option.help.length() > max_line_length-8) {
+                splitDesc(helpful, option.help);
             }else {
-                helpful += indent + i->second->help + '\n';
+                helpful.append("        ").append(option.help) += '\n';
             }
             helpful += '\n';
         }
     }
 
-    return helpful;
+    // another thread may have rendered it at the same time, which only costs
+    // the duplicate work
+    std::atomic_store(&help_cache, std::shared_ptr<const HelpText>(rendered));
+    return rendered;
 }
 
-ArgResults ArgParser::parse(const std::vector<std::string> &_args) {
-    ArgResults results;
+std::vector<std::string> ArgParser::suggest(std::string_view _name) const {
+    auto nameOf = [this](const std::uint32_t _known) {
+        std::size_t handle = _known >> 2;
+        return (_known & 3) == 0 ? defs->flag_names[handle] : (_known & 3) == 1 ? defs->option_names[handle] : defs->command_names[handle];
+    };
+    std::shared_ptr<const NameIndex> index = std::atomic_load(&name_index);
+    if(index == nullptr) {
+        auto built = std::make_shared<NameIndex>();
+        std::vector<std::uint32_t> commands(defs->command_order.size());
+        for(std::size_t c = 0; c < commands.size(); ++c) {
+            commands[c] = defs->command_order[c]*4+2;
+        }
+        // flags, options and commands are kept in order already, they only
+        // have to be merged
+        built->names.reserve(defs->long_names.size()+commands.size());
+        auto command = commands.begin();
+        for(const std::uint32_t target : defs->long_names) {
+            const std::uint32_t known = (target >> 1)*4+(target & 1);
+            while(command != commands.end() && nameOf(*command) < nameOf(known)) {
+                built->names.push_back(*command++);
+            }
+            built->names.push_back(known);
+        }
+        built->names.insert(built->names.end(), command, commands.end());
+        built->shared.resize(built->names.size());
+        for(std::size_t n = 1; n < built->names.size(); ++n) {
+            std::string_view a = nameOf(built->names[n-1]);
+            std::string_view b = nameOf(built->names[n]);
+            std::size_t common = 0;
+            while(common < a.size() && common < b.size() && a[common] == b[common]) {
+                ++common;
+            }
+            built->shared[n] = static_cast<std::uint32_t>(common);
+        }
+        built->next.assign(built->names.size(), static_cast<std::uint32_t>(built->names.size()));
+        std::vector<std::uint32_t> waiting;
+        for(std::size_t n = 0; n < built->names.size(); ++n) {
+            while(!waiting.empty() && built->shared[waiting.back()] > built->shared[n]) {
+                built->next[waiting.back()] = static_cast<std::uint32_t>(n);
+                waiting.pop_back();
+            }
+            waiting.push_back(static_cast<std::uint32_t>(n));
+        }
+        // like the help, another thread may have made it at the same time
+        std::atomic_store(&name_index, std::shared_ptr<const NameIndex>(built));
+        index = built;
+    }
+    const std::vector<std::uint32_t> &names = index->names;
+    const std::vector<std::uint32_t> &shared = index->shared;
+    const std::vector<std::uint32_t> &next = index->next;
 
-    for(auto i = flags.begin(); i != flags.end(); ++i) {
-        results.flag.insert(results.flag.end(), {i->first, false});
+    // about a third of the word may be wrong, at most three edits; from five
+    // letters on that covers two swapped letters
+    const std::size_t limit = std::min<std::size_t>(3, std::max<std::size_t>(1, (_name.size()+1)/3));
+    // row d holds the edit distances from each prefix of _name to the first d
+    // letters of the name being compared; names sharing letters share rows
+    const std::size_t width = _name.size()+1;
+    std::vector<std::size_t> rows(width);
+    for(std::size_t i = 0; i < width; ++i) {
+        rows[i] = i;
     }
-    for(auto i = options.begin(); i != options.end(); ++i) {
-        results.option.insert(results.option.end(), {i->first, i->second->defaults_to});
+    std::vector<std::pair<std::size_t, std::uint32_t>> found;
+    // widened one edit at a time until something is found: most typos are one
+    // or two edits, and a narrow search gives up on a name after a few letters
+    for(std::size_t radius = 1; radius <= limit && found.empty(); ++radius) {
+        // rows filled in for the name before
+        std::size_t filled = 0;
+        std::size_t n = 0;
+        while(n < names.size()) {
+            std::string_view candidate = nameOf(names[n]);
+            std::size_t depth = std::min<std::size_t>(filled, shared[n]);
+            // letters after which no name is within radius, 0 if none
+            std::size_t hopeless = 0;
+            for(; depth < candidate.size(); ++depth) {
+                if(rows.size() < (depth+2)*width) {
+                    rows.resize((depth+2)*width);
+                }
+                const std::size_t *above = &rows[depth*width];
+                std::size_t *row = &rows[(depth+1)*width];
+                // only cells within radius of the diagonal can be within radius,
+                // the ones just outside are marked as too far
+                const std::size_t first = depth+1 > radius ? depth+1-radius : 1;
+                const std::size_t last = std::min(width-1, depth+1+radius);
+                row[0] = depth+1;
+                if(first > 1) {
+                    row[first-1] = radius+1;
+                }
+                std::size_t least = first == 1 ? row[0] : radius+1;
+                for(std::size_t i = first; i <= last; ++i) {
+                    row[i] = std::min({above[i]+1, row[i-1]+1, above[i-1]+(_name[i-1] != candidate[depth])});
+                    least = std::min(least, row[i]);
+                }
+                if(last+1 < width) {
+                    row[last+1] = radius+1;
+                }
+                if(least > radius) {
+                    hopeless = depth+1;
+                    break;
+                }
+            }
+            if(hopeless != 0) {
+                // so are all the names starting with the same letters, which come next
+                ++n;
+                while(n < names.size() && shared[n] >= hopeless) {
+                    n = next[n];
+                }
+                filled = hopeless;
+                continue;
+            }
+            filled = candidate.size();
+            // a name that much longer or shorter is outside the band
+            const bool near = candidate.size() <= _name.size()+radius && _name.size() <= candidate.size()+radius;
+            const std::size_t d = near ? rows[candidate.size()*width+_name.size()] : radius+1;
+            if(d <= radius) {
+                found.emplace_back(d, names[n]);
+            }
+            ++n;
+        }
+    }
+    std::sort(found.begin(), found.end(), [&](const std::pair<std::size_t, std::uint32_t> &_a, const std::pair<std::size_t, std::uint32_t> &_b) {
+        return _a.first != _b.first ? _a.first < _b.first : nameOf(_a.second) < nameOf(_b.second);
+    });
+    std::vector<std::string> suggestions;
+    for(std::size_t i = 0; i < found.size() && i < 3; ++i) {
+        std::string_view candidate = nameOf(found[i].second);
+        suggestions.push_back((found[i].second & 3) == 2 ? std::string(candidate) : "--"+std::string(candidate));
+    }
+    return suggestions;
+}
+
+std::string ArgParser::help() const {
+    return layout()->text;
+}
+
+ArgFootprint ArgParser::footprint() const {
+    ArgFootprint f;
+    f.names = defs->flag_names.footprint()+defs->option_names.footprint()+defs->command_names.footprint()+defs->env.footprint();
+    f.definitions = sizeof(ArgDefinitions)-sizeof(defs->flags_abbr)-sizeof(defs->options_abbr)+ArgFootprint::of(name)+ArgFootprint::of(description);
+    f.definitions += defs->flags.capacity()*sizeof(ArgFlag)+defs->options.capacity()*sizeof(ArgOption)+defs->commands.capacity()*sizeof(ArgCommand);
+    for(const auto &flag : defs->flags) {
+        f.definitions += ArgFootprint::of(flag.help);
+    }
+    for(const auto &option : defs->options) {
+        f.definitions += ArgFootprint::of(option.help)+ArgFootprint::of(option.defaults_to)+option.allowed.footprint();
+        if(option.allowed_file != nullptr && option.allowed_file->loaded) {
+            f.definitions += sizeof(ArgAllowedFile)+ArgFootprint::of(option.allowed_file->path)+option.allowed_file->values.footprint();
+        }
+    }
+    f.indexes = sizeof(defs->flags_abbr)+sizeof(defs->options_abbr)+(defs->env_targets.capacity()+defs->long_names.capacity()+defs->command_order.capacity())*sizeof(std::uint32_t);
+    std::shared_ptr<const HelpText> cached = std::atomic_load(&help_cache);
+    if(cached != nullptr) {
+        f.help = sizeof(HelpText)+ArgFootprint::of(cached->text);
+    }
+    std::shared_ptr<const NameIndex> index = std::atomic_load(&name_index);
+    if(index != nullptr) {
+        f.indexes += sizeof(NameIndex)+index->names.capacity()*sizeof(std::uint32_t);
+    }
+    for(const auto &c : defs->commands) {
+        f.definitions += ArgFootprint::of(c.help);
+        if(c.scope == nullptr) {
+            continue;
+        }
+        f.definitions += sizeof(ArgSubcommand);
+        if(c.scope->built.load(std::memory_order_acquire)) {
+            ArgFootprint sub = c.scope->parser->footprint();
+            f.names += sub.names;
+            f.definitions += sizeof(ArgParser)+sub.definitions;
+            f.indexes += sub.indexes;
+            f.help += sub.help;
+        }
+    }
+    return f;
+}
+
+void ArgParser::help(std::ostream &_out) const {
+    std::shared_ptr<const HelpText> text = layout();
+    _out.write(text->text.data(), text->text.size());
+}
+
+std::size_t ArgParser::help(char *_buffer, const std::size_t _size) const {
+    std::shared_ptr<const HelpText> text = layout();
+    if(_size != 0) {
+        std::size_t n = text->text.size() < _size ? text->text.size() : _size-1;
+        std::memcpy(_buffer, text->text.data(), n);
+        _buffer[n] = '\0';
+    }
+    return text->text.size();
+}
+
+void ArgParser::replayConfig(Source &_src, ArgVisitor &_r) const {
+    std::shared_ptr<const ConfigFile> file = std::atomic_load(&config);
+    for(const auto &entry : file->entries) {
+        if(entry.target & 1) {
+            _r.option(entry.target >> 1, file->value(entry));
+            if(entry.converted) {
+                _r.typed(entry.target >> 1, entry.typed);
+            }
+        }else {
+            _r.flag(entry.target >> 1);
+        }
     }
+    _src.hold(std::move(file));
+}
 
-    std::size_t i = 0;
-    while(i < _args.size()) {
-        if(!_args[i].empty()) {
-            if(std::regex_match(_args[i], std::regex("^-[^-].*$"))) {
-                if(_args[i].length() > 2) {
-                    // multiple flags
-                    std::string stripped_arg = _args[i].substr(1);
-                    if(!validateOption(_args, stripped_arg, i, results)) {
+std::size_t ArgParser::parseArgs(Source &_src, ArgVisitor &_r) const {
+    std::string_view arg;
+    // a command has to be the first word, options may come before it
+    bool command = !defs->commands.empty();
+    std::size_t found = ArgDefinitions::npos;
+    while(_src.next(arg)) {
+        args::token t = args::classify(arg);
+        if(t.kind != args::token_kind::empty) {
+            if(t.kind == args::token_kind::short_cluster) {
+                std::string_view stripped_arg = arg.substr(1);
+                if(!validateAttached(stripped_arg, _r) && !validateOption(stripped_arg, t.equals == std::string_view::npos ? t.equals : t.equals-1, _src, _r)) {
+                    if(arg.length() > 2) {
+                        // multiple flags
                         for(std::size_t j = 0; j < stripped_arg.length(); ++j) {
-                            std::string f;
-                            f += stripped_arg[j];
-                            if(!validateFlag(f, results)) {
-                                throw args::invalid_argument(f);
+                            if(!validateFlag(stripped_arg.substr(j, 1), _r)) {
+                                throw args::invalid_argument(std::string(1, stripped_arg[j]));
                             }
                         }
-                        ++i;
-                    }else {
-                        i += 2;
-                    }
-                }else {
-                    std::string stripped_arg = _args[i].substr(1);
-                    if(!validateOption(_args, stripped_arg, i, results)) {
-                        if(!validateFlag(stripped_arg, results)) {
-                            throw args::invalid_argument(stripped_arg);
-                        }else {
-                            ++i;
-                        }
-                    }else {
-                        i += 2;
+                    }else if(!validateFlag(stripped_arg, _r)) {
+                        throw args::invalid_argument(std::string(stripped_arg));
                     }
                 }
-            }else if(std::regex_match(_args[i], std::regex("^--[^-].*$"))) {
-                std::string stripped_arg = _args[i].substr(2);
-                if(!validateOption(_args, stripped_arg, i, results)) {
-                    if(!validateFlag(stripped_arg, results)) {
-                        throw args::invalid_argument(stripped_arg);
-                    }else {
-                        ++i;
+            }else if(t.kind == args::token_kind::long_option || t.kind == args::token_kind::long_value) {
+                std::string_view stripped_arg = arg.substr(2);
+                std::size_t equals = t.equals == std::string_view::npos ? t.equals : t.equals-2;
+                if(!validateOption(stripped_arg, equals, _src, _r) && !validateFlag(stripped_arg, _r)) {
+                    if(!prefix_matching || !validatePrefix(stripped_arg, equals, _src, _r)) {
+                        throw args::invalid_argument(std::string(stripped_arg), suggest(stripped_arg.substr(0, equals)));
                     }
-                }else {
-                    i += 2;
-                }
-            }else if(i == 0 && !commands.empty()) {
-                if(commands.find(_args[i]) != commands.end()) {
-                    results.command = _args[i];
-                    ++i;
-                }else {
-                    results.positional.push_back(_args[i]);
-                    ++i;
                 }
             }else {
-                results.positional.push_back(_args[i]);
-                ++i;
+                if(command) {
+                    command = false;
+                    found = defs->findCommand(arg);
+                    if(found != ArgDefinitions::npos) {
+                        _r.command(arg);
+                        if(defs->commands[found].scope != nullptr) {
+                            return found;
+                        }
+                        continue;
+                    }
+                }
+                _r.positional(arg);
             }
+        }
+    }
+    return found;
+}
+
+template<class K, class R>
+void ArgParser::parseScope(Source &_src, R &_r, const std::size_t _args) const {
+    reset(_r, _args);
+    K sink(_r);
+    if(has_config) {
+        sink.layer = config_layer;
+        replayConfig(_src, sink);
+    }
+    if(!defs->env.empty()) {
+        sink.layer = env_layer;
+        readEnvironment(sink);
+    }
+    sink.layer = argv_layer;
+    std::size_t command = parseArgs(_src, sink);
+    _r.repeated.group();
+    split(_r.option);
+    sink.finish();
+    if constexpr(std::is_same<R, ArgResults>::value) {
+        _r.command_handle = command;
+    }
+    const ArgParser *sub = enter(command);
+    if(sub == nullptr) {
+        _r.subcommand.reset();
+        return;
+    }
+    // kept from the previous parse unless a copy of the results shares it
+    if(_r.subcommand == nullptr || _r.subcommand.use_count() > 1) {
+        if constexpr(std::is_same<R, ArgPmrResults>::value) {
+            _r.subcommand = std::allocate_shared<R>(std::pmr::polymorphic_allocator<R>(_r.positional.get_allocator()));
         }else {
-            ++i;
+            _r.subcommand = std::make_shared<R>();
         }
     }
+    sub->parseScope<K>(_src, *_r.subcommand, _args);
+}
+
+ArgResults ArgParser::parse(const std::vector<std::string> &_args) const {
+    ArgResults results;
+    parseInto(_args, results);
+
+    return results;
+}
+
+ArgResults ArgParser::parse(const char *const *_argv, const std::size_t _argc) const {
+    ArgResults results;
+    parseInto(_argv, _argc, results);
+
+    return results;
+}
+
+ArgResultsView ArgParser::parseView(const char *const *_argv, const std::size_t _argc) const {
+    ArgResultsView results;
+    parseInto(_argv, _argc, results);
+
+    return results;
+}
+
+void ArgParser::parseInto(const std::vector<std::string> &_args, ArgResults &_r) const {
+    Source src(_args, response_files);
+    parseScope<ResultsSink>(src, _r, _args.size());
+}
+
+void ArgParser::parseInto(const char *const *_argv, const std::size_t _argc, ArgResults &_r) const {
+    Source src(_argv, _argc, response_files);
+    parseScope<ResultsSink>(src, _r, _argc);
+}
+
+void ArgParser::parseInto(const char *const *_argv, const std::size_t _argc, ArgResultsView &_r) const {
+    Source src(_argv, _argc, response_files, &_r.files);
+    parseScope<ViewSink>(src, _r, _argc);
+}
+
+ArgPmrResults ArgParser::parse(const std::vector<std::string> &_args, std::pmr::memory_resource *_resource) const {
+    ArgPmrResults results(_resource);
+    parseInto(_args, results);
 
     return results;
 }
+
+ArgPmrResults ArgParser::parse(const char *const *_argv, const std::size_t _argc, std::pmr::memory_resource *_resource) const {
+    ArgPmrResults results(_resource);
+    parseInto(_argv, _argc, results);
+
+    return results;
+}
+
+void ArgParser::parseInto(const std::vector<std::string> &_args, ArgPmrResults &_r) const {
+    Source src(_args, response_files);
+    parseScope<PmrSink>(src, _r, _args.size());
+}
+
+void ArgParser::parseInto(const char *const *_argv, const std::size_t _argc, ArgPmrResults &_r) const {
+    Source src(_argv, _argc, response_files);
+    parseScope<PmrSink>(src, _r, _argc);
+}
+
+std::size_t ArgParser::visitScope(Source &_src, ArgVisitor &_v) const {
+    if(has_config) {
+        replayConfig(_src, _v);
+    }
+    if(!defs->env.empty()) {
+        readEnvironment(_v);
+    }
+    return parseArgs(_src, _v);
+}
+
+void ArgParser::visit(const std::vector<std::string> &_args, ArgVisitor &_v) const {
+    Source src(_args, response_files);
+    const ArgParser *p = this;
+    while(p != nullptr) {
+        p = p->enter(p->visitScope(src, _v));
+    }
+}
+
+void ArgParser::visit(const char *const *_argv, const std::size_t _argc, ArgVisitor &_v) const {
+    Source src(_argv, _argc, response_files);
+    const ArgParser *p = this;
+    while(p != nullptr) {
+        p = p->enter(p->visitScope(src, _v));
+    }
+}
+
+const ArgResults& ArgParser::route(const ArgResults &_r, const std::function<int(const ArgResults &)> *&_handler) {
+    _handler = nullptr;
+    const ArgResults *with = &_r;
+    std::string_view innermost;
+    // the results keep the definitions they were parsed with
+    for(const ArgResults *r = &_r; r != nullptr && r->command_handle != ArgDefinitions::npos; r = r->subcommand.get()) {
+        const ArgCommand &command = r->flag.defs->commands[r->command_handle];
+        innermost = r->command;
+        if(command.handler != nullptr) {
+            _handler = &command.handler;
+            with = r;
+        }
+    }
+    if(_handler == nullptr) {
+        throw args::no_handler(std::string(innermost));
+    }
+    return *with;
+}
+
+int ArgParser::dispatch(const ArgResults &_r) const {
+    const std::function<int(const ArgResults &)> *handler;
+    const ArgResults &with = route(_r, handler);
+    return (*handler)(with);
+}
+
+int ArgParser::repl(std::istream &_in, std::ostream &_out, const std::string &_prompt) const {
+    // kept across lines, so once the longest line has been seen nothing is allocated
+    std::string line;
+    std::vector<const char*> argv;
+    ArgResults results;
+    int status = 0;
+    while(true) {
+        if(!_prompt.empty()) {
+            _out << _prompt << std::flush;
+        }
+        if(!std::getline(_in, line)) {
+            break;
+        }
+        if(!splitLine(line, argv)) {
+            _out << "unterminated quote\n";
+            continue;
+        }
+        if(argv.empty()) {
+            continue;
+        }
+        // a handler that throws is reported like a line that does not parse
+        try {
+            parseInto(argv.data(), argv.size(), results);
+            const std::function<int(const ArgResults &)> *handler;
+            const ArgResults &with = route(results, handler);
+            status = (*handler)(with);
+        }catch(const std::exception &e) {
+            _out << e.what() << '\n';
+        }
+    }
+    return status;
+}
+
+void ArgParser::completion(std::ostream &_out, const args::shell _shell, const std::string &_program) const {
+    const std::string &program = _program.empty() ? name : _program;
+    // shell functions are named with letters, digits and underscores only
+    std::string function = "_";
+    for(char c : program) {
+        function += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+    }
+    function += "_complete";
+
+    if(_shell == args::shell::bash) {
+        _out << "# bash completion for " << program << "\n"
+            << function << "() {\n"
+            << "    local words=() lines=() line i\n"
+            << "    # bash splits --name=value around the =, the parser wants it whole\n"
+            << "    for ((i = 1; i <= COMP_CWORD; i++)); do\n"
+            << "        if ((${#words[@]} > 0)) && [[ ${COMP_WORDS[i]} == = || ${words[-1]} == *= ]]; then\n"
+            << "            words[-1]+=${COMP_WORDS[i]}\n"
+            << "        else\n"
+            << "            words+=(\"${COMP_WORDS[i]}\")\n"
+            << "        fi\n"
+            << "    done\n"
+            << "    # a reply replaces only what bash takes for the current word, which\n"
+            << "    # is nothing right after an =\n"
+            << "    local current=${COMP_WORDS[COMP_CWORD]}\n"
+            << "    [[ $current == = ]] && current=\n"
+            << "    local before=${words[-1]%\"$current\"}\n"
+            << "    mapfile -t lines < <(\"${COMP_WORDS[0]}\" __complete \"${words[@]}\" 2>/dev/null)\n"
+            << "    COMPREPLY=()\n"
+            << "    for line in \"${lines[@]}\"; do\n"
+            << "        line=${line%%$'\\t'*}\n"
+            << "        COMPREPLY+=(\"${line#\"$before\"}\")\n"
+            << "    done\n"
+            << "}\n"
+            << "complete -o default -F " << function << " " << program << "\n";
+    }else if(_shell == args::shell::zsh) {
+        _out << "#compdef " << program << "\n"
+            << "# zsh completion for " << program << "\n"
+            << function << "() {\n"
+            << "    local -a candidates\n"
+            << "    local line\n"
+            << "    for line in \"${(@f)$(\"${words[1]}\" __complete \"${(@)words[2,CURRENT]}\" 2>/dev/null)}\"; do\n"
+            << "        [[ -z $line ]] && continue\n"
+            << "        # _describe takes name:help, colons in the name are escaped\n"
+            << "        if [[ $line == *$'\\t'* ]]; then\n"
+            << "            candidates+=(\"${${line%%$'\\t'*}//:/\\\\:}:${line#*$'\\t'}\")\n"
+            << "        else\n"
+            << "            candidates+=(\"${line//:/\\\\:}\")\n"
+            << "        fi\n"
+            << "    done\n"
+            << "    _describe 'argument' candidates || _files\n"
+            << "}\n"
+            << "if [[ $funcstack[1] == " << function << " ]]; then\n"
+            << "    " << function << " \"$@\"\n"
+            << "else\n"
+            << "    compdef " << function << " " << program << "\n"
+            << "fi\n";
+    }else {
+        _out << "# fish completion for " << program << "\n"
+            << "function " << function << "\n"
+            << "    set -l words (commandline -opc)\n"
+            << "    set -l typed (commandline -ct)\n"
+            << "    $words[1] __complete $words[2..-1] \"$typed\" 2>/dev/null\n"
+            << "end\n"
+            << "complete -c " << program << " -a '(" << function << ")'\n";
+    }
+}
+
+std::string ArgParser::completion(const args::shell _shell, const std::string &_program) const {
+    std::ostringstream script;
+    completion(script, _shell, _program);
+    return script.str();
+}
+
+void ArgParser::completeValue(const std::size_t _option, std::string_view _before, std::string_view _value, std::ostream &_out) const {
+    const ArgOption &option = defs->options[_option];
+    std::string_view elements;
+    if(option.delimiter != '\0') {
+        std::size_t last = _value.rfind(option.delimiter);
+        if(last != std::string_view::npos) {
+            elements = _value.substr(0, last+1);
+            _value = _value.substr(last+1);
+        }
+    }
+    const ArgNames &allowed = allowedValues(option);
+    for(std::size_t v = 0; v < allowed.size(); ++v) {
+        if(allowed[v].substr(0, _value.size()) == _value) {
+            _out << _before << elements << allowed[v] << '\n';
+        }
+    }
+}
+
+void ArgParser::completeLast(Source &_src, std::ostream &_out) const {
+    auto write = [&_out](std::string_view _dashes, std::string_view _name, std::string_view _help) {
+        _out << _dashes << _name;
+        _help = _help.substr(0, _help.find('\n'));
+        if(!_help.empty()) {
+            _out << '\t' << _help;
+        }
+        _out << '\n';
+    };
+    // the option a name stands for the way parseArgs would read it, npos if none
+    auto optionOf = [](const ArgParser &_p, std::string_view _name, const bool _long) {
+        std::size_t option = _p.defs->findOption(_name);
+        if(option == ArgDefinitions::npos) {
+            option = _p.defs->findOptionAbbr(_name);
+        }
+        if(option == ArgDefinitions::npos && _long && _p.prefix_matching && _p.defs->findFlag(_name) == ArgDefinitions::npos && _p.defs->findFlagAbbr(_name) == ArgDefinitions::npos) {
+            try {
+                std::size_t target = _p.defs->findPrefix(_name);
+                if(target != ArgDefinitions::npos && (target & 1)) {
+                    option = target >> 1;
+                }
+            }catch(const args::ambiguous_argument &) {}
+        }
+        return option;
+    };
+
+    // the arguments before the last one only decide which parser it belongs
+    // to and whether it is the value of an option
+    const ArgParser *p = this;
+    bool command = !defs->commands.empty();
+    std::size_t value_of = ArgDefinitions::npos;
+    std::string_view typed;
+    std::string_view arg;
+    if(!_src.next(typed)) {
+        typed = std::string_view();
+    }
+    while(_src.next(arg)) {
+        std::string_view before = typed;
+        typed = arg;
+        if(value_of != ArgDefinitions::npos) {
+            value_of = ArgDefinitions::npos;
+            continue;
+        }
+        args::token t = args::classify(before);
+        if(t.kind == args::token_kind::short_cluster || t.kind == args::token_kind::long_option) {
+            const bool long_name = t.kind == args::token_kind::long_option;
+            std::string_view stripped = before.substr(long_name ? 2 : 1);
+            if(t.equals == std::string_view::npos) {
+                value_of = optionOf(*p, stripped, long_name);
+            }
+        }else if(t.kind == args::token_kind::word && command) {
+            command = false;
+            std::size_t found = p->defs->findCommand(before);
+            const ArgParser *sub = p->enter(found);
+            if(sub != nullptr) {
+                p = sub;
+                command = !p->defs->commands.empty();
+            }
+        }
+    }
+
+    if(value_of != ArgDefinitions::npos) {
+        p->completeValue(value_of, std::string_view(), typed, _out);
+    }else if(!typed.empty() && typed[0] == '-') {
+        const bool long_name = typed.size() == 1 || typed[1] == '-';
+        std::string_view stripped = typed.substr(long_name ? std::min<std::size_t>(2, typed.size()) : 1);
+        std::size_t equals = stripped.find('=');
+        if(equals != std::string_view::npos) {
+            std::size_t option = optionOf(*p, stripped.substr(0, equals), long_name);
+            if(option != ArgDefinitions::npos) {
+                p->completeValue(option, typed.substr(0, typed.size()-stripped.size()+equals+1), stripped.substr(equals+1), _out);
+            }
+        }else if(long_name) {
+            const ArgDefinitions &d = *p->defs;
+            std::pair<std::size_t, std::size_t> range = d.prefixed(stripped);
+            for(std::size_t i = range.first; i < range.second; ++i) {
+                const std::size_t target = d.long_names[i];
+                write("--", d.longName(target), target & 1 ? d.options[target >> 1].help : d.flags[target >> 1].help);
+            }
+        }
+    }else if(command) {
+        const ArgDefinitions &d = *p->defs;
+        std::pair<std::size_t, std::size_t> range = d.prefixedCommands(typed);
+        for(std::size_t i = range.first; i < range.second; ++i) {
+            write("", d.command_names[d.command_order[i]], d.commands[d.command_order[i]].help);
+        }
+    }
+}
+
+bool ArgParser::complete(const std::vector<std::string> &_args, std::ostream &_out) const {
+    Source src(_args, false);
+    std::string_view first;
+    if(!src.next(first) || first != "__complete") {
+        return false;
+    }
+    completeLast(src, _out);
+    return true;
+}
+
+bool ArgParser::complete(const char *const *_argv, const std::size_t _argc, std::ostream &_out) const {
+    Source src(_argv, _argc, false);
+    std::string_view first;
+    if(!src.next(first) || first != "__complete") {
+        return false;
+    }
+    completeLast(src, _out);
+    return true;
+}
+
+ArgFrozenParser ArgParser::freeze() const {
+    return ArgFrozenParser(*this);
+}
+
+// Frozen parser
+ArgFrozenParser::ArgFrozenParser(const ArgParser &_parser) : parser(_parser), help_text(parser.help()) {}
+
+const std::string& ArgFrozenParser::help() const {
+    return help_text;
+}
+
+void ArgFrozenParser::help(std::ostream &_out) const {
+    _out.write(help_text.data(), help_text.size());
+}
+
+std::size_t ArgFrozenParser::help(char *_buffer, const std::size_t _size) const {
+    if(_size != 0) {
+        std::size_t n = help_text.size() < _size ? help_text.size() : _size-1;
+        std::memcpy(_buffer, help_text.data(), n);
+        _buffer[n] = '\0';
+    }
+    return help_text.size();
+}
+
+ArgResults ArgFrozenParser::parse(const std::vector<std::string> &_args) const {
+    return parser.parse(_args);
+}
+
+ArgResultsView ArgFrozenParser::parseView(const char *const *_argv, const std::size_t _argc) const {
+    return parser.parseView(_argv, _argc);
+}
+
+void ArgFrozenParser::parseInto(const std::vector<std::string> &_args, ArgResults &_r) const {
+    parser.parseInto(_args, _r);
+}
+
+void ArgFrozenParser::parseInto(const char *const *_argv, const std::size_t _argc, ArgResults &_r) const {
+    parser.parseInto(_argv, _argc, _r);
+}
+
+void ArgFrozenParser::parseInto(const char *const *_argv, const std::size_t _argc, ArgResultsView &_r) const {
+    parser.parseInto(_argv, _argc, _r);
+}
+
+int ArgFrozenParser::dispatch(const ArgResults &_r) const {
+    return parser.dispatch(_r);
+}
+
+int ArgFrozenParser::repl(std::istream &_in, std::ostream &_out, const std::string &_prompt) const {
+    return parser.repl(_in, _out, _prompt);
+}
+
+bool ArgFrozenParser::complete(const std::vector<std::string> &_args, std::ostream &_out) const {
+    return parser.complete(_args, _out);
+}
+
+bool ArgFrozenParser::complete(const char *const *_argv, const std::size_t _argc, std::ostream &_out) const {
+    return parser.complete(_argv, _argc, _out);
+}
+
+ArgPmrResults ArgFrozenParser::parse(const std::vector<std::string> &_args, std::pmr::memory_resource *_resource) const {
+    return parser.parse(_args, _resource);
+}
+
+ArgPmrResults ArgFrozenParser::parse(const char *const *_argv, const std::size_t _argc, std::pmr::memory_resource *_resource) const {
+    return parser.parse(_argv, _argc, _resource);
+}
+
+void ArgFrozenParser::parseInto(const std::vector<std::string> &_args, ArgPmrResults &_r) const {
+    parser.parseInto(_args, _r);
+}
+
+void ArgFrozenParser::parseInto(const char *const *_argv, const std::size_t _argc, ArgPmrResults &_r) const {
+    parser.parseInto(_argv, _argc, _r);
+}
+
+void ArgFrozenParser::visit(const std::vector<std::string> &_args, ArgVisitor &_v) const {
+    parser.visit(_args, _v);
+}
+
+void ArgFrozenParser::visit(const char *const *_argv, const std::size_t _argc, ArgVisitor &_v) const {
+    parser.visit(_argv, _argc, _v);
+}
+
+std::vector<ArgBatchResult> ArgFrozenParser::parseBatch(const std::vector<std::vector<std::string>> &_batch, const unsigned _threads) const {
+    return parseBatch(_batch.data(), _batch.size(), _threads);
+}
+
+void ArgFrozenParser::schedule(const std::size_t _size, unsigned _threads, const std::function<void(std::size_t)> &_job) {
+    if(_threads == 0) {
+        _threads = std::thread::hardware_concurrency();
+    }
+    if(_threads > _size) {
+        _threads = static_cast<unsigned>(_size);
+    }
+    if(_threads <= 1) {
+        for(std::size_t i = 0; i < _size; ++i) {
+            _job(i);
+        }
+        return;
+    }
+    if(_size > 0xffffffff) {
+        for(std::size_t offset = 0; offset < _size; offset += 0xffffffff) {
+            std::size_t block = _size-offset < 0xffffffff ? _size-offset : 0xffffffff;
+            schedule(block, _threads, [&](std::size_t _i) {
+                _job(offset+_i);
+            });
+        }
+        return;
+    }
+
+    // Each worker owns a range of entries, packed as begin << 32 | end. It takes
+    // small chunks from the front of its own range and, once that is empty,
+    // steals the back half of the largest range left.
+    auto pack = [](std::uint64_t _begin, std::uint64_t _end) {
+        return (_begin << 32) | _end;
+    };
+    std::vector<std::atomic<std::uint64_t>> ranges(_threads);
+    for(std::size_t w = 0; w < _threads; ++w) {
+        ranges[w].store(pack(_size*w/_threads, _size*(w+1)/_threads));
+    }
+
+    auto worker = [&](std::size_t _w) {
+        while(true) {
+            std::uint64_t r = ranges[_w].load();
+            while((r >> 32) < (r & 0xffffffff)) {
+                std::uint64_t begin = r >> 32;
+                std::uint64_t end = r & 0xffffffff;
+                std::uint64_t take = (end-begin+3)/4 < 16 ? (end-begin+3)/4 : 16;
+                if(ranges[_w].compare_exchange_weak(r, pack(begin+take, end))) {
+                    for(std::uint64_t i = begin; i < begin+take; ++i) {
+                        _job(i);
+                    }
+                    r = ranges[_w].load();
+                }
+            }
+
+            bool stolen = false;
+            while(!stolen) {
+                std::size_t victim = _w;
+                std::uint64_t most = 0;
+                for(std::size_t v = 0; v < ranges.size(); ++v) {
+                    std::uint64_t other = ranges[v].load();
+                    std::uint64_t left = (other & 0xffffffff)-(other >> 32);
+                    if(v != _w && (other >> 32) < (other & 0xffffffff) && left > most) {
+                        victim = v;
+                        most = left;
+                    }
+                }
+                if(victim == _w) {
+                    return;
+                }
+
+                std::uint64_t other = ranges[victim].load();
+                std::uint64_t begin = other >> 32;
+                std::uint64_t end = other & 0xffffffff;
+                if(begin >= end) {
+                    continue;
+                }
+                std::uint64_t middle = begin+(end-begin)/2;
+                if(ranges[victim].compare_exchange_strong(other, pack(begin, middle))) {
+                    ranges[_w].store(pack(middle, end));
+                    stolen = true;
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for(std::size_t w = 1; w < _threads; ++w) {
+        pool.emplace_back(worker, w);
+    }
+    worker(0);
+    for(auto &t : pool) {
+        t.join();
+    }
+}